@@ -0,0 +1,134 @@
+#!/bin/sh
+# Checks that the ways h2m has of getting to the same translation all get there.
+# Each check runs h2m on the headers in this directory (and Tests) in two ways
+# and compares the output files, which must be identical. The checks are:
+#   spill           function interfaces moved to a temporary file (-spill-limit)
+#                   are written out just as those held in memory
+#   single-parse    a recursive run parsing only the top header (-single-parse)
+#                   gives the same modules as one parsing each header on its own
+#   cache           a run reusing the modules of an earlier one (-cache-dir) gives
+#                   the same output as that run and as a run without a cache
+#   incremental     after a header changes, an -incremental run translates only
+#                   that header and the headers including it, and gives the same
+#                   output as a run from scratch
+
+# Reports the error condition and exits
+error_report ()
+{
+  echo "Error. $1">&2
+  exit 1
+}
+
+print_help ()
+{
+  echo "check_modes.sh options:"
+  echo "-h2m gives the h2m executable to check (default h2m on the PATH)"
+  echo "-keep leaves the output files in the scratch directory for inspection"
+  exit "$1"
+}
+
+# Default values of variables which may appear on command line
+h2m=h2m
+keep=0
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    -h2m) h2m="$2"; shift;;
+    -keep) keep=1;;
+    -help|--help|-h) print_help 0;;
+    *) echo "Unknown option: $1">&2; print_help 1;;
+  esac
+  shift
+done
+
+here=$(cd "$(dirname "$0")" && pwd) || error_report "Unable to find the test headers."
+scratch=$(mktemp -d "${TMPDIR:-/tmp}/h2m_check.XXXXXX") ||
+    error_report "Unable to make a scratch directory."
+failures=0
+
+# Runs h2m with the arguments given, quietly. The output file is one of them. The
+# exit status is not looked at, since some test headers are meant to give errors,
+# but the output is kept (-keep-going) so that a missing one fails the comparison.
+run_h2m ()
+{
+  "$h2m" "$@" -silent -keep-going 2>>"$scratch/stderr.txt"
+}
+
+# Checks the number of modules an -incremental run reused, from what it reports.
+reused ()
+{
+  if grep -q "^Incremental run: $2 of $3 modules reused" "$4"; then
+    echo "ok      $1"
+  else
+    echo "FAILED  $1 (expected $2 of $3 modules reused, see $4)"
+    failures=$((failures + 1))
+  fi
+}
+
+# Compares two output files and counts a failure if they differ.
+same_output ()
+{
+  if [ -f "$2" ] && cmp -s "$2" "$3"; then
+    echo "ok      $1"
+  else
+    echo "FAILED  $1 ($2 and $3 differ)"
+    failures=$((failures + 1))
+  fi
+}
+
+# A limit of one byte moves the interfaces to a temporary file on the first write.
+for header in "$here/../function_tests.h" "$here/use_only_top.h"; do
+  name=$(basename "$header" .h)
+  run_h2m "$header" -together -out="$scratch/$name.f90"
+  run_h2m "$header" -together -spill-limit=1 -out="$scratch/${name}_spill.f90"
+  same_output "spill $name" "$scratch/$name.f90" "$scratch/${name}_spill.f90"
+done
+
+# The system headers are left out, since they are parsed differently (see the
+# -single-parse option in the README).
+for header in "$here/top_file.h" "$here/use_only_top.h"; do
+  name=$(basename "$header" .h)
+  run_h2m "$header" -recursive -no-system-headers -out="$scratch/${name}_headers.f90"
+  run_h2m "$header" -recursive -no-system-headers -single-parse \
+      -out="$scratch/${name}_single.f90"
+  same_output "single-parse $name" "$scratch/${name}_headers.f90" \
+      "$scratch/${name}_single.f90"
+done
+
+# The first run fills the cache, the second (warm) run reuses every module.
+for header in "$here/top_file.h" "$here/use_only_top.h"; do
+  name=$(basename "$header" .h)
+  cache="$scratch/${name}_cache"
+  run_h2m "$header" -recursive -out="$scratch/${name}_plain.f90"
+  run_h2m "$header" -recursive -cache-dir="$cache" -out="$scratch/${name}_cold.f90"
+  run_h2m "$header" -recursive -cache-dir="$cache" -out="$scratch/${name}_warm.f90"
+  same_output "cold cache $name" "$scratch/${name}_plain.f90" "$scratch/${name}_cold.f90"
+  same_output "warm cache $name" "$scratch/${name}_cold.f90" "$scratch/${name}_warm.f90"
+done
+
+# The headers are copied so that one can be changed. use_only_counts.h includes
+# use_only_types.h and is included by use_only_top.h, so changing it leaves only
+# the module of use_only_types.h to be reused. The run has to report the count,
+# so it can't be silent.
+copy="$scratch/incremental"
+mkdir "$copy" || error_report "Unable to make $copy."
+cp "$here"/use_only_*.h "$copy" || error_report "Unable to copy the headers."
+output="$scratch/incremental.f90"
+"$h2m" "$copy/use_only_top.h" -recursive -incremental -keep-going -out="$output" \
+    2>"$scratch/first_run.txt"
+"$h2m" "$copy/use_only_top.h" -recursive -incremental -keep-going -out="$output" \
+    2>"$scratch/unchanged_run.txt"
+reused "incremental unchanged" 3 3 "$scratch/unchanged_run.txt"
+echo "/* Changed for the incremental check. */" >>"$copy/use_only_counts.h"
+"$h2m" "$copy/use_only_top.h" -recursive -incremental -keep-going -out="$output" \
+    2>"$scratch/changed_run.txt"
+reused "incremental changed" 1 3 "$scratch/changed_run.txt"
+run_h2m "$copy/use_only_top.h" -recursive -out="$scratch/incremental_plain.f90"
+same_output "incremental output" "$scratch/incremental_plain.f90" "$output"
+
+if [ "$keep" -eq 0 ] && [ "$failures" -eq 0 ]; then
+  rm -rf "$scratch"
+else
+  echo "The output files are in $scratch."
+fi
+[ "$failures" -eq 0 ] || error_report "$failures check(s) failed."
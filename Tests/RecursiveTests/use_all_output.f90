@@ -0,0 +1,62 @@
+! The following Fortran code was generated by the h2m-AutoFortran Tool.
+! See the h2m README file for credits and help information.
+
+MODULE module_use_only_types
+USE, INTRINSIC :: iso_c_binding
+implicit none
+INTEGER(C_INT), parameter, public :: max_points = 16
+TYPE, BIND(C) :: point
+    INTEGER(C_INT) :: x
+    INTEGER(C_INT) :: y
+END TYPE point
+INTEGER(C_INT), public, BIND(C) :: value
+INTEGER(C_INT), public, BIND(C) :: total_count
+END MODULE module_use_only_types
+
+
+MODULE module_use_only_counts
+USE, INTRINSIC :: iso_c_binding
+USE module_use_only_types
+implicit none
+! Found duplicate identifier.
+! INTEGER(C_LONG), public, BIND(C) :: Point
+END MODULE module_use_only_counts
+
+
+MODULE module_use_only_top
+USE, INTRINSIC :: iso_c_binding
+USE module_use_only_types
+USE module_use_only_counts
+implicit none
+TYPE(point), public, BIND(C) :: origin = point(0, 0)
+TYPE, BIND(C) :: segment
+    TYPE(point) :: start
+    TYPE(point) :: finish
+    INTEGER(C_INT) :: total_count
+END TYPE segment
+INTERFACE
+INTEGER(C_INT) FUNCTION count_points(points, total_count) BIND(C)
+    USE iso_c_binding, only: C_INT, C_PTR
+    import
+    TYPE(C_PTR), value :: points
+    INTEGER(C_INT), value :: total_count
+END FUNCTION count_points
+
+SUBROUTINE move_point(by, value) BIND(C)
+    USE iso_c_binding, only: C_LONG
+    import
+    TYPE(point), value :: by
+    INTEGER(C_LONG), value :: value
+END SUBROUTINE move_point
+
+SUBROUTINE scale_points(count, weights) BIND(C)
+    USE iso_c_binding, only: C_DOUBLE, C_INT
+    import
+    INTEGER(C_INT), value :: count
+    REAL(C_DOUBLE), DIMENSION(count + max_points) :: weights
+END SUBROUTINE scale_points
+
+END INTERFACE
+END MODULE module_use_only_top
+
+
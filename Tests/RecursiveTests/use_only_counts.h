@@ -0,0 +1,10 @@
+#ifndef use_only_counts
+#define use_only_counts
+
+#include "use_only_types.h"
+
+// To Fortran this is the same name as struct point in use_only_types.h. This
+// module keeps its own, but the modules after it use the first one.
+long Point;
+
+#endif
@@ -0,0 +1,24 @@
+// This tests the USE... ONLY statements of a recursive run. Translated with
+// h2m -recursive, it should give use_only_output.f90. With -use-all-modules as
+// well, it should give use_all_output.f90, where Point is a duplicate.
+#include "use_only_types.h"
+#include "use_only_counts.h"
+
+struct point origin = {0, 0};
+
+// total_count and value are declared in use_only_types.h, but a component, a
+// dummy argument or the VALUE attribute is not a reference to them.
+struct segment {
+  struct point start;
+  struct point finish;
+  int total_count;
+};
+
+int count_points(struct point *points, int total_count);
+
+void move_point(struct point by, long value);
+
+// The bound of weights can't be worked out, so it is copied as it is written, and
+// max_points, from use_only_types.h, must be imported for it. count is a dummy
+// argument, so it must not be.
+void scale_points(int count, double weights[count + max_points]);
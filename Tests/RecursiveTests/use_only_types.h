@@ -0,0 +1,15 @@
+#ifndef use_only_types
+#define use_only_types
+
+#define max_points 16
+
+struct point {
+  int x;
+  int y;
+};
+
+int value;
+
+int total_count;
+
+#endif
@@ -0,0 +1,26 @@
+// This file tests the initialization of the char types. Plain char is a
+// CHARACTER, but signed char and unsigned char are INTEGERs, so their
+// values should be written as integers. It should compile without complaint.
+
+char plain_char = 'a';
+
+signed char signed_char = -5;
+
+unsigned char unsigned_char = 'a';
+
+unsigned char large_unsigned_char = 200;
+
+char plain_char_array[2] = {'a', 'b'};
+
+unsigned char unsigned_char_array[] = {1, 2};
+
+signed char signed_char_array[2][2] = {{1, -1}, {2, -2}};
+
+unsigned char unsigned_char_literal[] = "hi";
+
+struct char_holder {
+  char plain;
+  unsigned char small;
+};
+
+struct char_holder held_chars = {'x', 250};
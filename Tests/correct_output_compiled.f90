@@ -715,3 +715,77 @@ END FUNCTION return_struct_pointer
 
 END INTERFACE
 END MODULE module_mini
+! The following Fortran code was generated by the h2m-AutoFortran Tool.
+! See the h2m README file for credits and help information.
+
+MODULE module_char_kind_tests
+USE, INTRINSIC :: iso_c_binding
+implicit none
+CHARACTER(C_CHAR), parameter, public :: plain_char = 'a'
+INTEGER(C_SIGNED_CHAR), parameter, public :: signed_char = -5
+INTEGER(C_SIGNED_CHAR), parameter, public :: unsigned_char = 97
+INTEGER(C_SIGNED_CHAR), parameter, public :: large_unsigned_char = -56
+CHARACTER(C_CHAR), BIND(C) :: plain_char_array(2) = RESHAPE((/'a', 'b'/), (/2/))
+INTEGER(C_SIGNED_CHAR), BIND(C) :: unsigned_char_array(2) = RESHAPE((/1, 2/), (/2/))
+INTEGER(C_SIGNED_CHAR), BIND(C) :: signed_char_array(2, 2) = RESHAPE((/1, -1, 2, -2/), (/2, 2/))
+INTEGER(C_SIGNED_CHAR), BIND(C) :: unsigned_char_literal(3) = RESHAPE((/104, 105, 0/), (/3/))
+TYPE, BIND(C) :: char_holder
+    CHARACTER(C_CHAR) :: plain
+    INTEGER(C_SIGNED_CHAR) :: small
+END TYPE char_holder
+TYPE(char_holder), public, BIND(C) :: held_chars = char_holder('x', -6)
+END MODULE module_char_kind_tests
+! The following Fortran code was generated by the h2m-AutoFortran Tool.
+! See the h2m README file for credits and help information.
+
+MODULE module_stdint_tests
+USE, INTRINSIC :: iso_c_binding
+implicit none
+TYPE, BIND(C) :: my_index
+    INTEGER(C_INT64_T)::my_index_C_INT64_T
+END TYPE my_index
+TYPE, BIND(C) :: my_other_index
+    INTEGER(C_INT64_T)::my_other_index_C_INT64_T
+END TYPE my_other_index
+INTEGER(C_INT8_T), public, BIND(C) :: an_int8
+INTEGER(C_INT16_T), public, BIND(C) :: a_uint16
+INTEGER(C_INT32_T), public, BIND(C) :: an_int32
+INTEGER(C_INT64_T), public, BIND(C) :: a_const_int64
+INTEGER(C_INT64_T), public, BIND(C) :: a_uint64
+INTEGER(C_INTPTR_T), public, BIND(C) :: an_intptr
+INTEGER(C_INTPTR_T), public, BIND(C) :: a_uintptr
+INTEGER(C_PTRDIFF_T), public, BIND(C) :: a_ptrdiff
+INTEGER(C_SIZE_T), public, BIND(C) :: a_size
+INTEGER(C_INTMAX_T), public, BIND(C) :: an_intmax
+INTEGER(C_INT_LEAST32_T), public, BIND(C) :: a_least32
+INTEGER(C_INT_FAST64_T), public, BIND(C) :: a_fast64
+INTEGER(C_INT64_T), public, BIND(C) :: an_index
+INTEGER(C_INT8_T), parameter, public :: small_int8 = -3
+INTEGER(C_INT8_T), parameter, public :: large_uint8 = -56
+INTEGER(C_INT8_T), BIND(C) :: byte_table(3) = RESHAPE((/1, 2, -1/), (/3/))
+INTEGER(C_INT8_T), BIND(C) :: signed_table(2, 2) = RESHAPE((/1, -1, 2, -2/), (/2, 2/))
+INTEGER(C_INT8_T), BIND(C) :: byte_literal(4) = RESHAPE((/104, 50, 109, 0/), (/4/))
+TYPE, BIND(C) :: index_array
+    TYPE(C_PTR) :: indices
+    INTEGER(C_SIZE_T) :: length
+    INTEGER(C_INT64_T) :: first
+    INTEGER(C_INT64_T) :: fixed(4)
+END TYPE index_array
+INTERFACE
+INTEGER(C_INT64_T) FUNCTION sum_indices(indices, length, start) BIND(C)
+    USE iso_c_binding, only: C_INT64_T, C_PTR, C_SIZE_T
+    import
+    TYPE(C_PTR), value :: indices
+    INTEGER(C_SIZE_T), value :: length
+    INTEGER(C_INT64_T), value :: start
+END FUNCTION sum_indices
+
+INTEGER(C_INT32_T) FUNCTION checksum(bytes, count) BIND(C)
+    USE iso_c_binding, only: C_INT32_T, C_PTR, C_PTRDIFF_T
+    import
+    TYPE(C_PTR), value :: bytes
+    INTEGER(C_PTRDIFF_T), value :: count
+END FUNCTION checksum
+
+END INTERFACE
+END MODULE module_stdint_tests
@@ -5,6 +5,10 @@
 #define this_macro_is_too_long_to_be_a_fortran_macro_because_there_are_line_limits_in_fortran
 #define this_macr_name_is_exactly_63_characters_long_thus_should_be_ok();
 
+// The number alone is too long for a line, so it cannot be continued and should
+// be commented out (or only warned about with -ignore-line-length).
+#define this_macro_value_has_nowhere_to_split 1.000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000001
+
 
 int this_function_will_produce_lines_too_long_woe_is_us(int argument1, double argument2, void* argument3,
     char argument4, char* argument5, int argument6);
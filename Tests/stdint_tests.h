@@ -0,0 +1,43 @@
+// This file tests the translation of the exact width and other
+// special integer types of stdint.h and stddef.h, which should
+// get their own kinds (ie C_INT64_T) whatever they are underneath.
+// It should compile without complaint.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int64_t my_index;
+typedef my_index my_other_index;
+
+extern int8_t an_int8;
+extern uint16_t a_uint16;
+extern int32_t an_int32;
+extern const int64_t a_const_int64;
+extern uint64_t a_uint64;
+extern intptr_t an_intptr;
+extern uintptr_t a_uintptr;
+extern ptrdiff_t a_ptrdiff;
+extern size_t a_size;
+extern intmax_t an_intmax;
+extern int_least32_t a_least32;
+extern int_fast64_t a_fast64;
+extern my_other_index an_index;
+
+// The 8-bit types are INTEGER(C_INT8_T), not CHARACTER, so their
+// initial values must be written as integers rather than as characters.
+int8_t small_int8 = -3;
+uint8_t large_uint8 = 200;
+uint8_t byte_table[] = {1, 2, 255};
+int8_t signed_table[2][2] = {{1, -1}, {2, -2}};
+uint8_t byte_literal[] = "h2m";
+
+struct index_array {
+  int64_t *indices;
+  size_t length;
+  my_index first;
+  int64_t fixed[4];
+};
+
+int64_t sum_indices(const int64_t *indices, size_t length, my_other_index start);
+
+uint32_t checksum(const uint8_t *bytes, ptrdiff_t count);
@@ -0,0 +1,154 @@
+#!/bin/sh
+# Generates large C headers for measuring how h2m scales. Every size can be
+# chosen, so the same headers can be generated over and over at growing sizes
+# (see scale_bench.sh). The headers written to the output directory are:
+#   macros.h        integer, hex, floating point and string macros
+#   wide_struct.h   a struct with many fields
+#   wide_function.h functions with many parameters
+#   big_array.h     initialized arrays with many elements
+#   tree/top.h      the top of a tree of headers including each other, like
+#                   Tests/RecursiveTests. Each level has the same number of
+#                   headers and each of them includes every header of the
+#                   next level, so the headers below the top are shared.
+
+# Reports the error condition and exits
+error_report ()
+{
+  echo "Error. $1">&2
+  exit 1
+}
+
+print_help ()
+{
+  echo "gen_headers.sh options:"
+  echo "-dir gives the directory to write the headers into (required)"
+  echo "-macros gives the number of macros of each kind (default 1000)"
+  echo "-fields gives the number of fields of the struct (default 1000)"
+  echo "-functions gives the number of functions (default 100)"
+  echo "-params gives the number of parameters of each function (default 64)"
+  echo "-elements gives the number of elements of each array (default 10000)"
+  echo "-depth gives the number of levels of the include tree (default 4)"
+  echo "-fanout gives the number of headers on each level of the tree (default 3)"
+  echo "-decls gives the number of declarations in each header of the tree (default 50)"
+  exit "$1"
+}
+
+# Default values of variables which may appear on command line
+dir=""
+macros=1000
+fields=1000
+functions=100
+params=64
+elements=10000
+depth=4
+fanout=3
+decls=50
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    -dir) dir="$2"; shift;;
+    -macros) macros="$2"; shift;;
+    -fields) fields="$2"; shift;;
+    -functions) functions="$2"; shift;;
+    -params) params="$2"; shift;;
+    -elements) elements="$2"; shift;;
+    -depth) depth="$2"; shift;;
+    -fanout) fanout="$2"; shift;;
+    -decls) decls="$2"; shift;;
+    -help|--help|-h) print_help 0;;
+    *) echo "Unknown option: $1">&2; print_help 1;;
+  esac
+  shift
+done
+
+if [ -z "$dir" ]; then
+  error_report "An output directory must be given with -dir."
+fi
+mkdir -p "$dir/tree" || error_report "Unable to create $dir/tree."
+
+# The headers are written by awk. A loop in the shell is far too slow at these sizes.
+awk -v n="$macros" 'BEGIN {
+  print "#ifndef GEN_MACROS_H"
+  print "#define GEN_MACROS_H"
+  for (i = 0; i < n; i++) {
+    printf "#define GEN_INT_%d %d\n", i, i
+    printf "#define GEN_HEX_%d 0x%XUL\n", i, (i * 40503) % 2147483648
+    printf "#define GEN_FLOAT_%d %d.25e-3f\n", i, i
+    printf "#define GEN_STRING_%d \"generated string %d\"\n", i, i
+  }
+  print "#endif"
+}' > "$dir/macros.h" || error_report "Unable to write $dir/macros.h."
+
+awk -v n="$fields" 'BEGIN {
+  split("int;unsigned long;double;char *;float;long long;short;void *", types, ";")
+  print "#ifndef GEN_WIDE_STRUCT_H"
+  print "#define GEN_WIDE_STRUCT_H"
+  print "struct gen_wide_struct {"
+  for (i = 0; i < n; i++) {
+    printf "  %s field_%d;\n", types[i % 8 + 1], i
+  }
+  print "};"
+  print "#endif"
+}' > "$dir/wide_struct.h" || error_report "Unable to write $dir/wide_struct.h."
+
+awk -v n="$functions" -v p="$params" 'BEGIN {
+  split("int;unsigned long;double;char *;const float *;long long;short;void *", types, ";")
+  print "#ifndef GEN_WIDE_FUNCTION_H"
+  print "#define GEN_WIDE_FUNCTION_H"
+  for (f = 0; f < n; f++) {
+    printf "int gen_function_%d(", f
+    for (i = 0; i < p; i++) {
+      printf "%s%s arg_%d", (i == 0 ? "" : ", "), types[(i + f) % 8 + 1], i
+    }
+    print ");"
+  }
+  print "#endif"
+}' > "$dir/wide_function.h" || error_report "Unable to write $dir/wide_function.h."
+
+awk -v n="$elements" 'BEGIN {
+  print "#ifndef GEN_BIG_ARRAY_H"
+  print "#define GEN_BIG_ARRAY_H"
+  printf "int gen_int_table[%d] = {", n
+  for (i = 0; i < n; i++) {
+    printf "%s%d", (i == 0 ? "" : ", "), i * 7
+  }
+  print "};"
+  printf "double gen_double_table[%d] = {", n
+  for (i = 0; i < n; i++) {
+    printf "%s%d.5", (i == 0 ? "" : ", "), i
+  }
+  print "};"
+  print "#endif"
+}' > "$dir/big_array.h" || error_report "Unable to write $dir/big_array.h."
+
+# The tree. Level 0 is included by top.h and the last level includes nothing.
+awk -v depth="$depth" -v fanout="$fanout" -v decls="$decls" -v dir="$dir/tree" 'BEGIN {
+  top = dir "/top.h"
+  print "#ifndef GEN_TOP_H" > top
+  print "#define GEN_TOP_H" > top
+  for (h = 0; h < fanout; h++) {
+    printf "#include \"level_0_%d.h\"\n", h > top
+  }
+  print "int gen_top_function(int);" > top
+  print "#endif" > top
+  close(top)
+  for (l = 0; l < depth; l++) {
+    for (h = 0; h < fanout; h++) {
+      name = "level_" l "_" h
+      file = dir "/" name ".h"
+      printf "#ifndef GEN_%s_H\n#define GEN_%s_H\n", toupper(name), toupper(name) > file
+      if (l + 1 < depth) {
+        for (c = 0; c < fanout; c++) {
+          printf "#include \"level_%d_%d.h\"\n", l + 1, c > file
+        }
+      }
+      for (d = 0; d < decls; d++) {
+        printf "#define %s_MACRO_%d %d\n", toupper(name), d, d > file
+        printf "struct %s_struct_%d { int a; double b; char c[8]; };\n", name, d > file
+        printf "double %s_function_%d(int a, double *b);\n", name, d > file
+      }
+      print "#endif" > file
+      close(file)
+    }
+  }
+}' || error_report "Unable to write the include tree in $dir/tree."
@@ -0,0 +1,292 @@
+// This file contains h2m_bench, a microbenchmark for the h2m formatter
+// classes. Each case generates a header in memory, parses it once with
+// runToolOnCodeWithArgs and then runs a single formatter over every
+// declaration (or macro) in it, over and over, reporting the time and
+// the number of allocations spent on each declaration. It is built with
+// -DBENCH=ON and is meant for measuring changes to the formatters.
+
+#include "formatters.h"
+#include <new>
+
+using namespace clang;
+
+//------------Allocation counting---------------------------------------------------------
+// Every allocation made by the benchmark goes through here so that allocations per
+// declaration can be reported. Only the count matters, so malloc does the work.
+static std::atomic<unsigned long long> allocations(0);
+
+void *operator new(size_t size) {
+  allocations++;
+  void *memory = malloc(size == 0 ? 1 : size);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+void *operator new[](size_t size) {
+  allocations++;
+  void *memory = malloc(size == 0 ? 1 : size);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+void operator delete(void *memory) noexcept { free(memory); }
+void operator delete[](void *memory) noexcept { free(memory); }
+
+//------------Options---------------------------------------------------------------------
+static cl::OptionCategory BenchOpts("Options for the h2m formatter benchmark");
+
+static cl::opt<unsigned> Iterations("iterations", cl::init(20), cl::cat(BenchOpts),
+    cl::desc("Number of times each formatter is run over every declaration"));
+
+// Scales every case: the number of macros, variables and functions, the number of
+// fields of each struct and the number of elements of each initialized array.
+static cl::opt<unsigned> Size("size", cl::init(1000), cl::cat(BenchOpts),
+    cl::desc("Size of the generated headers"));
+
+static cl::opt<string> Filter("filter", cl::cat(BenchOpts),
+    cl::desc("Only run the cases whose names contain this string"));
+
+//------------Cases-----------------------------------------------------------------------
+// Which formatter a case measures.
+enum BenchKind {TYPE, MACRO, VAR, FUNCTION, RECORD};
+
+struct BenchCase {
+  string name;
+  BenchKind kind;
+  string code;  // The generated header
+};
+
+// What a case measured, summed over every iteration.
+struct BenchResult {
+  string name;
+  unsigned decls = 0;  // Declarations (or macros) formatted in one iteration
+  double seconds = 0;
+  unsigned long long allocations = 0;
+  unsigned long long bytes = 0;  // Size of the text the formatter returned
+  bool ran = false;
+};
+
+// A mix of the types seen in real headers, for the type and function cases.
+static const char *BenchTypes[] = {"int", "unsigned long", "double", "char *",
+    "const float *", "long double", "short", "unsigned char", "long long",
+    "struct bench_opaque *", "void *", "_Bool"};
+static const unsigned NumBenchTypes = sizeof(BenchTypes) / sizeof(BenchTypes[0]);
+
+static std::vector<BenchCase> MakeCases(unsigned size) {
+  std::vector<BenchCase> cases;
+  BenchCase types = {"type", TYPE, "struct bench_opaque;\n"};
+  for (unsigned i = 0; i < size; i++) {
+    types.code += string("extern ") + BenchTypes[i % NumBenchTypes] + " type_" +
+        std::to_string(i) + ";\n";
+  }
+  cases.push_back(types);
+
+  BenchCase ints = {"macro-int", MACRO, ""};
+  BenchCase hexes = {"macro-hex", MACRO, ""};
+  BenchCase floats = {"macro-float", MACRO, ""};
+  BenchCase strings = {"macro-string", MACRO, ""};
+  for (unsigned i = 0; i < size; i++) {
+    string number = std::to_string(i);
+    char hex[32];
+    snprintf(hex, sizeof(hex), "0x%XUL", i * 2654435761u);
+    ints.code += "#define INT_" + number + " " + number + "\n";
+    hexes.code += "#define HEX_" + number + " " + hex + "\n";
+    floats.code += "#define FLOAT_" + number + " " + number + ".25e-3f\n";
+    strings.code += "#define STRING_" + number + " \"bench string " + number + "\"\n";
+  }
+  cases.push_back(ints);
+  cases.push_back(hexes);
+  cases.push_back(floats);
+  cases.push_back(strings);
+
+  // A few large initialized tables, the most expensive variables seen in practice.
+  BenchCase tables = {"var-initializer", VAR, ""};
+  for (unsigned table = 0; table < 10; table++) {
+    tables.code += "int table_" + std::to_string(table) + "[" + std::to_string(size) +
+        "] = {";
+    for (unsigned i = 0; i < size; i++) {
+      tables.code += (i == 0 ? "" : ", ") + std::to_string(i * 7 + table);
+    }
+    tables.code += "};\n";
+  }
+  cases.push_back(tables);
+
+  // Functions with many parameters of mixed types.
+  BenchCase functions = {"function-wide", FUNCTION, "struct bench_opaque;\n"};
+  for (unsigned function = 0; function < std::max(1u, size / 10); function++) {
+    functions.code += "int function_" + std::to_string(function) + "(";
+    for (unsigned i = 0; i < 64; i++) {
+      functions.code += (i == 0 ? "" : ", ") + string(BenchTypes[(i + function) % NumBenchTypes]) +
+          " arg_" + std::to_string(i);
+    }
+    functions.code += ");\n";
+  }
+  cases.push_back(functions);
+
+  // Structs with many fields.
+  BenchCase records = {"record-wide", RECORD, "struct bench_opaque;\n"};
+  for (unsigned record = 0; record < 10; record++) {
+    records.code += "struct record_" + std::to_string(record) + " {\n";
+    for (unsigned i = 0; i < size; i++) {
+      records.code += string("  ") + BenchTypes[(i + record) % NumBenchTypes] + " field_" +
+          std::to_string(i) + ";\n";
+    }
+    records.code += "};\n";
+  }
+  cases.push_back(records);
+  return cases;
+}
+
+//------------Front end-------------------------------------------------------------------
+typedef std::vector<std::pair<Token, const MacroDirective *>> BenchMacroList;
+
+// Keeps every macro defined in the generated header for the macro cases.
+class BenchMacros : public PPCallbacks {
+public:
+  BenchMacros(BenchMacroList &macros, SourceManager &sm) : macros(macros), sm(sm) {}
+  void MacroDefined(const Token &MacroNameTok, const MacroDirective *MD) override {
+    if (sm.isInMainFile(MD->getLocation())) {
+      macros.push_back(std::make_pair(MacroNameTok, MD));
+    }
+  }
+private:
+  BenchMacroList &macros;
+  SourceManager &sm;
+};
+
+// Runs the case's formatter over every declaration once the header has been parsed,
+// while the AST and the preprocessor's macros are still around.
+class BenchConsumer : public ASTConsumer {
+public:
+  BenchConsumer(CompilerInstance &ci, const BenchCase &bench, BenchMacroList &macros,
+      BenchResult &result) : ci(ci), bench(bench), macros(macros), result(result) {
+    rewriter.setSourceMgr(ci.getSourceManager(), ci.getLangOpts());
+  }
+
+  void HandleTranslationUnit(ASTContext &context) override {
+    SourceManager &sm = ci.getSourceManager();
+    std::vector<Decl *> decls;
+    for (Decl *d : context.getTranslationUnitDecl()->decls()) {
+      if (sm.isInMainFile(d->getLocation()) == false) {
+        continue;
+      }
+      if ((bench.kind == TYPE || bench.kind == VAR) && isa<VarDecl>(d)) {
+        decls.push_back(d);
+      } else if (bench.kind == FUNCTION && isa<FunctionDecl>(d)) {
+        decls.push_back(d);
+      } else if (bench.kind == RECORD && isa<RecordDecl>(d) &&
+          cast<RecordDecl>(d)->isCompleteDefinition()) {
+        decls.push_back(d);
+      }
+    }
+    result.decls = bench.kind == MACRO ? macros.size() : decls.size();
+
+    // The arguments need an output file, though the formatters only return strings.
+    SmallString<128> scratch;
+    int fd;
+    if (sys::fs::createTemporaryFile("h2m_bench", "f90", fd, scratch)) {
+      errs() << "Error: unable to create a scratch output file.\n";
+      return;
+    }
+    llvm::tool_output_file scratch_file(scratch, fd);
+    Arguments args(true, true, scratch_file, false, false, false, false, false, false,
+        false, false, false, false);
+    // Types are remembered just as h2m remembers them while translating an AST.
+    TypeCache type_cache(context);
+    args.setTypeCache(&type_cache);
+
+    unsigned long long allocations_before = allocations;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (unsigned iteration = 0; iteration < Iterations; iteration++) {
+      // Otherwise everything after the first iteration is a duplicate identifier.
+      args.getSymbols().clear();
+      if (bench.kind == MACRO) {
+        for (const std::pair<Token, const MacroDirective *> &macro : macros) {
+          MacroFormatter mf(macro.first, macro.second, ci, args);
+          result.bytes += mf.getFortranMacroASString().size();
+        }
+      }
+      for (Decl *d : decls) {
+        if (bench.kind == TYPE) {
+          VarDecl *vd = cast<VarDecl>(d);
+          bool problem = false;
+          CToFTypeFormatter tf(vd->getType(), context, sm.getPresumedLoc(vd->getLocation()),
+              args);
+          result.bytes += tf.getFortranTypeASString(true, problem).size();
+        } else if (bench.kind == VAR) {
+          VarDeclFormatter vdf(cast<VarDecl>(d), rewriter, args);
+          result.bytes += vdf.getFortranVarDeclASString().size();
+        } else if (bench.kind == FUNCTION) {
+          FunctionDeclFormatter fdf(cast<FunctionDecl>(d), rewriter, args);
+          result.bytes += fdf.getFortranFunctDeclASString().size();
+        } else if (bench.kind == RECORD) {
+          RecordDeclFormatter rdf(cast<RecordDecl>(d), rewriter, args);
+          result.bytes += rdf.getFortranStructASString().size();
+        }
+      }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    result.seconds = elapsed.count();
+    result.allocations = allocations - allocations_before;
+    result.ran = true;
+  }
+
+private:
+  CompilerInstance &ci;
+  const BenchCase &bench;
+  BenchMacroList &macros;
+  BenchResult &result;
+  Rewriter rewriter;
+};
+
+class BenchAction : public ASTFrontendAction {
+public:
+  BenchAction(const BenchCase &bench, BenchResult &result) : bench(bench), result(result) {}
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &ci,
+      StringRef file) override {
+    ci.getPreprocessor().addPPCallbacks(llvm::make_unique<BenchMacros>(macros,
+        ci.getSourceManager()));
+    return llvm::make_unique<BenchConsumer>(ci, bench, macros, result);
+  }
+private:
+  const BenchCase &bench;
+  BenchResult &result;
+  BenchMacroList macros;
+};
+
+int main(int argc, const char **argv) {
+  cl::HideUnrelatedOptions(BenchOpts);
+  cl::ParseCommandLineOptions(argc, argv, "h2m formatter benchmark\n");
+
+  std::vector<BenchResult> results;
+  for (const BenchCase &bench : MakeCases(Size)) {
+    if (Filter.size() && bench.name.find(Filter) == string::npos) {
+      continue;
+    }
+    BenchResult result;
+    result.name = bench.name;
+    // The tool takes ownership of the action. The header is parsed as C.
+    if (runToolOnCodeWithArgs(new BenchAction(bench, result), bench.code, {"-xc"},
+        "h2m_bench.h") == false || result.ran == false) {
+      errs() << "Error: the " << bench.name << " case failed to parse.\n";
+      return(1);
+    }
+    results.push_back(result);
+  }
+
+  outs() << "h2m formatter benchmark: " << Iterations << " iterations, size " << Size << "\n";
+  outs() << format("%-18s %8s %14s %14s %14s\n", "case", "decls", "ns/decl",
+      "allocs/decl", "bytes/decl");
+  for (const BenchResult &result : results) {
+    double count = double(result.decls) * Iterations;
+    if (count == 0) {
+      outs() << format("%-18s %8u %14s %14s %14s\n", result.name.c_str(), 0u, "-", "-", "-");
+      continue;
+    }
+    outs() << format("%-18s %8u %14.1f %14.2f %14.1f\n", result.name.c_str(), result.decls,
+        result.seconds * 1e9 / count, result.allocations / count, result.bytes / count);
+  }
+  return(0);
+}
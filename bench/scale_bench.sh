@@ -0,0 +1,116 @@
+#!/bin/sh
+# Measures how h2m's time and memory grow with the size of its input. Headers
+# are generated (see gen_headers.sh) at each scale given, h2m is run over each
+# of them (normally, and over the include tree with -recursive and -together as
+# well), and the time and peak memory of every run are reported. The exponent
+# column compares each run with the same case at the scale before it: near 1
+# the case grows linearly, near 2 it grows quadratically. The peak memory is
+# the one h2m reports itself (-stats-json).
+
+# Reports the error condition and exits
+error_report ()
+{
+  echo "Error. $1">&2
+  exit 1
+}
+
+print_help ()
+{
+  echo "scale_bench.sh options:"
+  echo "-h2m gives the path to the h2m executable (required)"
+  echo "-dir gives the directory to work in (default ./h2m_scale)"
+  echo "-scales gives the sizes to run at, as multiples of the base size (default \"1 2 4 8\")"
+  echo "-depth gives the number of levels of the include tree (default 4)"
+  echo "-fanout gives the number of headers on each level of the tree (default 3)"
+  exit "$1"
+}
+
+# Default values of variables which may appear on command line
+h2m=""
+dir="./h2m_scale"
+scales="1 2 4 8"
+depth=4
+fanout=3
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    -h2m) h2m="$2"; shift;;
+    -dir) dir="$2"; shift;;
+    -scales) scales="$2"; shift;;
+    -depth) depth="$2"; shift;;
+    -fanout) fanout="$2"; shift;;
+    -help|--help|-h) print_help 0;;
+    *) echo "Unknown option: $1">&2; print_help 1;;
+  esac
+  shift
+done
+
+if [ -z "$h2m" ] || [ ! -x "$h2m" ]; then
+  error_report "An h2m executable must be given with -h2m."
+fi
+generator="$(dirname "$0")/gen_headers.sh"
+[ -f "$generator" ] || error_report "Unable to find $generator."
+mkdir -p "$dir" || error_report "Unable to create $dir."
+results="$dir/results.txt"
+: > "$results"
+
+# The time in nanoseconds, or in whole seconds where date can't do better.
+now_ns ()
+{
+  t=$(date +%s%N 2>/dev/null)
+  case "$t" in
+    *N|"") echo "$(date +%s)000000000";;
+    *) echo "$t";;
+  esac
+}
+
+# Runs h2m on one input and records the result. The arguments are the name of the
+# case, the scale, the input and then any options for h2m. The options must come
+# before the input, since everything after the input is given to Clang.
+run_case ()
+{
+  name="$1"; scale="$2"; input="$3"; shift 3
+  output="$dir/out_${scale}/${name}.f90"
+  rm -f "$output" "$output.stats.json"
+  start=$(now_ns)
+  "$h2m" -q -s -k -stats-json -out="$output" "$@" "$input" >/dev/null 2>&1
+  status=$?
+  end=$(now_ns)
+  rss=$(grep '"peak_rss_kb"' "$output.stats.json" 2>/dev/null | tr -dc 0-9)
+  [ -z "$rss" ] && rss="-"
+  seconds=$(awk -v s="$start" -v e="$end" 'BEGIN { printf "%.3f", (e - s) / 1e9 }')
+  echo "$name $scale $seconds $rss $status" >> "$results"
+  echo "  $name: ${seconds}s, peak ${rss} KB, exit status $status"
+}
+
+for scale in $scales; do
+  headers="$dir/headers_${scale}"
+  echo "Scale $scale: generating headers in $headers"
+  sh "$generator" -dir "$headers" -macros $((1000 * scale)) -fields $((1000 * scale)) \
+      -functions $((100 * scale)) -params 64 -elements $((10000 * scale)) \
+      -depth "$depth" -fanout "$fanout" -decls $((50 * scale)) || exit 1
+  mkdir -p "$dir/out_${scale}" || error_report "Unable to create $dir/out_${scale}."
+  run_case macros "$scale" "$headers/macros.h"
+  run_case wide_struct "$scale" "$headers/wide_struct.h"
+  run_case wide_function "$scale" "$headers/wide_function.h"
+  run_case big_array "$scale" "$headers/big_array.h"
+  run_case tree "$scale" "$headers/tree/top.h"
+  run_case tree_recursive "$scale" "$headers/tree/top.h" -recursive
+  run_case tree_together "$scale" "$headers/tree/top.h" -together
+done
+
+# Each case is compared with its own run at the scale before.
+echo ""
+sort -k1,1 -k2,2n "$results" | awk '
+BEGIN { printf "%-16s %8s %10s %14s %10s %8s\n", "case", "scale", "seconds", "peak_rss_kb", "exponent", "status" }
+{
+  exponent = "-"
+  if (($1 in last_scale) && last_seconds[$1] > 0 && $3 > 0 && $2 != last_scale[$1]) {
+    exponent = sprintf("%.2f", log($3 / last_seconds[$1]) / log($2 / last_scale[$1]))
+  }
+  printf "%-16s %8s %10s %14s %10s %8s\n", $1, $2, $3, $4, exponent, $5
+  last_scale[$1] = $2
+  last_seconds[$1] = $3
+}'
+echo ""
+echo "Results are kept in $results."
@@ -30,14 +30,30 @@
 #include "clang/Lex/PPCallbacks.h"
 #include "clang/Lex/Preprocessor.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/ToolOutputFile.h"
+// Used to translate several headers at once during a recursive run
+#include "llvm/Support/ThreadPool.h"
+// Used to name precompiled headers and cached translations after their contents
+#include "llvm/Support/MD5.h"
+#include "clang/Basic/Version.h"
+// Used to choose the headers of a project (-header-filter)
+#include "llvm/Support/Regex.h"
+// Used to time the phases of a run (-time-report)
+#include "llvm/Support/Timer.h"
+// Used to print the slowest declarations (-profile-decls)
+#include "llvm/Support/Format.h"
 
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <string>
 #include <sstream>
 // Set, deque, and stack are needed to keep track of files seen by the preprocessor
@@ -45,10 +61,24 @@
 #include <set>
 #include <deque>
 #include <stack>
+// A priority queue keeps the slowest declarations seen (-profile-decls)
+#include <queue>
 // Map is used to assign unique module names if there are duplicate file names
 #include <map>
+// Repeated warnings are spotted by the hash of what they say (see Diagnostics)
+#include <unordered_map>
 // Used to determine whether or not a character has a lowercase equivalent
 #include <locale>
+// Used to hold the translations of a recursive run and to find the number of cores
+#include <vector>
+#include <thread>
+#include <algorithm>
+// Guards structures shared by the workers of a parallel run
+#include <mutex>
+#include <atomic>
+#include <chrono>
+// Used to find the peak memory use of a run (-stats-json)
+#include <sys/resource.h>
 
 // These were here when I got here (though it may not be a good idea) 
 // and it is too difficult to take them out now...
@@ -60,6 +90,11 @@ using namespace std;
 
 //------------Utility Classes for Argument parsing etc------------------------------------
 class Arguments;  // This class uses part of CToFTypeFormatter, but CTFTF needs it, too
+class ModuleSplitter;  // Defined in h2m.h, only a pointer is kept in the Arguments
+class TimeReport;  // Likewise
+class TypeCache;  // Defined below, after CToFTypeFormatter
+class TimeTrace;  // Likewise
+class DeclProfile;  // Likewise
 
 //------------Formatter class decl----------------------------------------------------------------------------------------------------
 // This class holds a variety of functions used to transform C syntax into Fortran.
@@ -138,22 +173,292 @@ public:
   // and only work on some types (short, int, long...)
   static string createFortranType(const string macroName, const string macroVal,
       PresumedLoc loc, Arguments &args);
-  // This somewhat complicated function handles emitting all errors and returning
-  // a (potentially) commented out string to the main translation routine as
-  // needed according to the status passed in and the values in args.
-  static string EmitTranslationAndErrors(status current_status, string error_string,
-      string translation_string, PresumedLoc sloc, Arguments &args);
+  // This somewhat complicated function handles emitting all errors and writing
+  // the (potentially) commented out text to the stream given as needed according
+  // to the status passed in and the values in args.
+  static void EmitTranslationAndErrors(status current_status, string error_string,
+      StringRef translation_string, PresumedLoc sloc, Arguments &args, raw_ostream &out);
   // Prints an error location (file and line).
   static void LineError(PresumedLoc sloc); 
+  // Reports a warning and the location it concerns to the run's diagnostics, or
+  // straight to standard error (followed by LineError) if there are none. The
+  // caller still decides whether the run is too quiet for it.
+  static void Report(status current_status, const string &message, PresumedLoc sloc,
+      Arguments &args);
+  // Likewise, but for a warning which is not about a problem with the translation
+  // (ie a pointer set to C_NULL_PTR). The rule names the kind of warning in the
+  // diagnostics file. These are the rules used.
+  static const char *const RENAMED;
+  static const char *const EMPTY_STRUCT;
+  static const char *const COMMENTED_OUT;
+  static const char *const ARRAY_DIMENSIONS;
+  static const char *const NULL_POINTER;
+  static const char *const UNKNOWN_DECL;
+  static void Warn(const char *rule, const string &message, PresumedLoc sloc,
+      Arguments &args);
+  // Determines whether a declaration or macro at the given location should be
+  // kept out of the translation because it lives in a system header. Normally
+  // this is always the case, but during a single-parse recursive run the system
+  // headers get modules of their own (unless -no-system-headers was given).
+  static bool isExcludedSystemHeader(SourceLocation loc, SourceManager &sm,
+      Arguments &args);
   // Constants to be used for length checking when comparing names/lines
   // to see if they are valid Fortran.
   static const int name_max = 63;
   static const int line_max = 132;
+  // The most continuation lines one statement may have (Fortran 2003).
+  static const int continuation_max = 255;
 private:
+  // Does the work of getFortranTypeASString when the answer isn't cached.
+  string TranslateType(bool typeWrapper, bool &problem);
+
   Arguments &args;
 };
 
+// Passes translated text on to another stream as it is written, starting every
+// line with "! " while commenting out is on. EmitTranslationAndErrors uses this to
+// comment out a translation on its way to the output instead of rebuilding it.
+// This is also the one place where line lengths are checked. A line of code
+// longer than line_max is split with "&" continuations at a comma or a space
+// (or anywhere inside a character literal) as it goes out. Commented out lines
+// and trailing comments are left alone since their length does not matter.
+class TranslationWriter : public raw_ostream {
+public:
+  // Nothing is buffered here except the unfinished line of code being written.
+  // The stream written to does its own buffering.
+  explicit TranslationWriter(raw_ostream &out) : raw_ostream(true), out(out) {}
+  ~TranslationWriter() override {
+    flush();
+    FinishLine();
+  }
+  // Comments out each line begun from now on, or stops doing so.
+  void setCommentOut(bool comment) {
+    FinishLine();
+    comment_out = comment;
+  }
+  // Writes out whatever is left of an unfinished line.
+  void FinishLine();
+  // Finds the first line of the text longer than line_max which can't be continued
+  // legally: it has nowhere safe to split, so it would go out too long, or it needs
+  // more than continuation_max continuation lines. If there is none, it is empty.
+  static StringRef FindUnsplitLine(StringRef text);
+
+private:
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return position; }
+  // Writes out one line of code (without its newline), continued as needed.
+  void WriteLine(StringRef line);
+  // Writes the line to out (if given) in continued pieces. False is returned if it
+  // is too long and has nowhere to split, in which case the rest goes out as is, or
+  // if it takes more than continuation_max continuation lines.
+  static bool ContinueLine(StringRef line, raw_ostream *out);
+
+  raw_ostream &out;
+  bool comment_out = false;
+  // Whether the next character written begins a line.
+  bool line_start = true;
+  // The start of a line of code written in pieces. It is only split when it ends.
+  string pending;
+  uint64_t position = 0;
+};
+
+// Holds translated text along with where each of its lines begins, recorded as the
+// text is appended. Going through the lines then needs no split of the text. Line
+// lengths are not checked here. TranslationWriter does that as the text goes out.
+class LineBuffer {
+public:
+  LineBuffer() {}
+  LineBuffer &operator=(StringRef more) {
+    clear();
+    append(more);
+    return *this;
+  }
+  LineBuffer &operator+=(StringRef more) {
+    append(more);
+    return *this;
+  }
+  void append(StringRef more);
+  // Appends the text with every line commented out ("! "), ending its last line.
+  void appendCommentedOut(StringRef more);
+  void clear();
+  const string &str() const { return text; }
+  bool empty() const { return text.empty(); }
+  // The number of lines, counting an unfinished last line.
+  size_t getLineCount() const;
+  // The text of a line, without its newline.
+  StringRef getLine(size_t line) const;
+
+private:
+  string text;
+  // The offset of the start of every line. The last may not be finished yet.
+  std::vector<size_t> line_starts = {0};
+};
+
 //------------Utility Classes for Argument parsing etc------------------------------------
+// Each duplicate identifier check made while translating a module, in order: the
+// identifier (as compared) and whether it was new. See Arguments::getGuardLog.
+typedef std::vector<std::pair<string, bool>> GuardLog;
+
+// Counts of what happened during the translation of one module (or a whole run),
+// written out for the statistics file (-stats-json).
+struct TranslationStats {
+  // The declarations seen by the visitor, by kind (ie "Function" or "Record").
+  std::map<string, unsigned> declarations;
+  // Declarations not translated because they are not in the main file, or because
+  // they are in a system header which is being excluded.
+  unsigned skipped_not_main = 0;
+  unsigned skipped_system = 0;
+  // The status of every translation given to EmitTranslationAndErrors, and how
+  // many of each were commented out, indexed by CToFTypeFormatter::status.
+  unsigned statuses[CToFTypeFormatter::BAD_ARRAY + 1] = {};
+  unsigned commented_out[CToFTypeFormatter::BAD_ARRAY + 1] = {};
+  // Macros translated, and those whose translation was not empty.
+  unsigned macros_processed = 0;
+  unsigned macros_emitted = 0;
+  // Bytes of Fortran written to the output for the module.
+  size_t bytes_emitted = 0;
+
+  // Adds another set of counts into this one.
+  void Add(const TranslationStats &other);
+  // The name of a status code (ie "BAD_TYPE"), or "UNKNOWN" for anything else.
+  static const char *getStatusName(int status);
+  // Writes the counts as the members of a JSON object, without the braces.
+  void WriteJSON(raw_ostream &out, const string &indent) const;
+};
+
+// Collects the warnings raised during a run as records of a rule (the status of the
+// problem, or one of the rules of CToFTypeFormatter::Warn), a message and the place
+// in the source it concerns. A record repeated exactly (which happens when
+// a header is seen more than once) is only counted again. The text of each new
+// record goes to standard error as before, but through a buffer which is written
+// out in large pieces (see Flush) instead of piece by piece. The records can also
+// be written to a file as JSON or SARIF (-diagnostics-file). One of these is shared
+// by every worker of a parallel run, so it is guarded by a lock.
+class Diagnostics {
+public:
+  enum Format {JSON, SARIF};
+
+  struct Record {
+    const char *rule;  // A status name or a warning rule, never freed
+    const char *level;  // The SARIF level, "warning" or "error"
+    string message;
+    string file;  // Empty if the location was invalid
+    unsigned line;
+    unsigned column;
+    unsigned count;  // How many times this was reported
+  };
+
+  // keep is whether the records are kept for a diagnostics file. Otherwise only
+  // enough is kept to spot repeats.
+  explicit Diagnostics(bool keep) : keep_records(keep) {}
+  ~Diagnostics() { Flush(); }
+  // Records a warning about a problem with the given status, and buffers its text
+  // (followed by its location) for standard error unless it is a repeat.
+  void Report(CToFTypeFormatter::status status, const string &message, PresumedLoc sloc);
+  // Likewise for a warning which has a rule of its own instead of a status.
+  void Warn(const char *rule, const string &message, PresumedLoc sloc);
+  // Writes the buffered text to standard error. This is done whenever enough has
+  // built up, and before h2m reports on a whole module so that the warnings still
+  // come out before the report about their module.
+  void Flush();
+  // Writes every record to the named file. Returns false if it can't be written.
+  bool WriteFile(const string &path, Format format);
+  unsigned getReported() { return reported; }
+  unsigned getRepeats() { return repeats; }
+
+private:
+  static const size_t flush_size = 64 * 1024;
+
+  void Add(const char *rule, const char *level, const string &message, PresumedLoc sloc);
+
+  std::mutex lock;
+  bool keep_records;
+  std::vector<Record> records;
+  // The place in records of every record seen, by the hash of its rule, location
+  // and message. The messages themselves are only kept for a diagnostics file.
+  std::unordered_map<size_t, unsigned> seen;
+  string text;  // Waiting to be written to standard error
+  unsigned reported = 0;
+  unsigned repeats = 0;
+};
+
+// Remembers the Fortran types given by CToFTypeFormatter::getFortranTypeASString
+// for the types of one ASTContext, since a header uses the same few types over and
+// over. Types are uniqued by the ASTContext, so a QualType (the Type pointer and its
+// qualifiers) is a key. The type is not made canonical first because the answer
+// depends on how the type is spelled (ie size_t and unsigned long differ). Each form
+// (wrapped, "INTEGER(C_INT)", or bare, "C_INT") is filled in when first asked for.
+// A cache must not outlive its ASTContext, whose types may be reused by the next.
+class TypeCache {
+public:
+  struct Entry {
+    string forms[2];  // Indexed by whether the form is wrapped
+    bool known[2] = {false, false};
+    bool problem[2] = {false, false};  // Likewise, kept apart in case they differ
+  };
+
+  explicit TypeCache(const ASTContext &context) : context(context) {}
+  // The entry of the given type of the given context, or a null pointer if the
+  // context is not the one this cache belongs to.
+  Entry *getEntry(QualType qt, const ASTContext &ac) {
+    if (&ac != &context) {
+      return nullptr;
+    }
+    return &entries[qt.getAsOpaquePtr()];
+  }
+
+private:
+  const ASTContext &context;
+  llvm::DenseMap<void *, Entry> entries;
+};
+
+// The identifiers declared by the translation, kept so that a duplicate can be found
+// and commented out. Fortran is not case sensitive, so names are compared folded
+// to lower case (only ASCII, as in a Fortran name). Each Fortran module is a scope
+// of its own. A -together run puts everything in the one scope, "". Each symbol
+// records what declared it first, and where, so that a duplicate can name it.
+// When the modules are chained (-use-all-modules), each one USEs all the modules
+// before it, so a scope also sees every name declared earlier in any other scope.
+class SymbolTable {
+public:
+  struct Symbol {
+    const char *kind;  // ie "function", or "" if unknown (from a cached translation)
+    string file;  // Empty if the location was unknown
+    unsigned line;
+  };
+
+  SymbolTable() { setScope(""); }
+  // Makes the named scope (a module, or a file during a single-parse run) the one
+  // declared in and looked in, creating it if it is new.
+  void setScope(StringRef scope);
+  // Whether each scope sees the names declared earlier in the others. Set before
+  // anything is declared.
+  void setChained(bool chain) { chained = chain; }
+  // Declares a folded name (see Fold) in the current scope. Returns the symbol which
+  // declared it first if it is a duplicate, or a null pointer if it is new.
+  const Symbol *Declare(StringRef folded, const char *kind, PresumedLoc sloc);
+  bool isDeclared(StringRef folded) const {
+    return scopes[current].count(folded) > 0 || (chained && earlier.count(folded) > 0);
+  }
+  // Adds every name declared in the named scope to names, in no particular order.
+  void getNames(StringRef scope, std::vector<string> &names) const;
+  // Forgets every scope and symbol.
+  void clear();
+  // The form in which a name is compared, put in the buffer given (which can be
+  // used again for the next name, so a lookup need not make a string).
+  static StringRef Fold(StringRef name, SmallVectorImpl<char> &buffer);
+  // Describes where a symbol was first declared, for the duplicate warning.
+  static string Describe(const Symbol &symbol);
+
+private:
+  std::vector<StringMap<Symbol>> scopes;
+  StringMap<unsigned> scope_ids;
+  unsigned current = 0;
+  bool chained = false;
+  // When chained, the first declaration of every name in any scope.
+  StringMap<Symbol> earlier;
+};
+
 // This is used to pass arguments to the tool factories and actions so I don't have to keep
 // changing them if more are added. This keeps track of the quiet and silent options,
 // as well as the output file, and allows greater flexibility in the future.
@@ -173,11 +478,21 @@ public:
       quiet(q), silent(s), output(out), no_system_headers(sysheaders) ,
       together(t), array_transpose(a), auto_bind(b), hide_macros(h) {
      module_name = "";
+     splitter = nullptr;
+     output_redirect = nullptr;
+     guard_log = nullptr;
+     time_report = nullptr;
+     time_trace = nullptr;
+     stats = nullptr;
+     decl_profile = nullptr;
+     diagnostics = nullptr;
+     type_cache = nullptr;
+     spill_limit = 0;
      int i = 0;
      // Initialize the array which tells us what problems, 
      // usually commented out, should be ignored. The defaults
      // are to ignore nothing.
-     for (i = 0; i < CToFTypeFormatter::BAD_ARRAY; i++) {
+     for (i = 0; i <= CToFTypeFormatter::BAD_ARRAY; i++) {
        should_ignore[i] = false;
      }
      // Now initialize the specifically passed in options.
@@ -191,6 +506,17 @@ public:
    }
   // These functions are setters and getters for the arguments members.
   llvm::tool_output_file &getOutput() { return output; }
+  // Translations should be written here rather than straight to the output file.
+  // Usually this is just the output file's stream, but a recursive run may send
+  // each module's translation to a buffer first so that the modules can be
+  // translated in any order (or at the same time) and still be written in the
+  // proper order, or so that the USE statements can be chosen from it.
+  raw_ostream &getOutputStream() {
+    return output_redirect != nullptr ? *output_redirect : output.os();
+  }
+  // Sends translations to the given stream until this is called again with a null
+  // pointer. The stream is not owned by the arguments.
+  void setOutputRedirect(raw_ostream *redirect) { output_redirect = redirect; }
   bool getQuiet() { return quiet; } 
   bool getSilent() { return silent; }
   bool getNoSystemHeaders() { return no_system_headers; }
@@ -202,6 +528,10 @@ public:
   bool getArrayTranspose() { return array_transpose; }
   bool getAutobind() { return auto_bind; }
   bool getHideMacros() { return hide_macros; }
+  // During a single-parse recursive run, this points to the object which sorts
+  // translations into per-file modules. Otherwise it is a null pointer.
+  ModuleSplitter *getSplitter() { return splitter; }
+  void setSplitter(ModuleSplitter *split) { splitter = split; }
   // This will tell us if we should comment out problems 
   // associated witht he status passed in as status_num.
   // A value of true means we should comment the status
@@ -212,6 +542,57 @@ public:
     return !should_ignore[status_num];
   }
   string GenerateModuleName(string Filename);
+  // All the identifiers declared so far, by module, for the duplicate identifier
+  // check. See RecordDeclFormatter::StructAndTypedefGuard.
+  SymbolTable &getSymbols() { return symbols; }
+  // While a translation is being recorded for the translation cache (-cache-dir)
+  // every duplicate identifier check is logged here, because the translation
+  // depends on what was declared before it in the same scope. Otherwise this is a null pointer.
+  GuardLog *getGuardLog() { return guard_log; }
+  void setGuardLog(GuardLog *log) { guard_log = log; }
+  // Where the time spent in each phase is recorded during a timed run (-time-report).
+  // Otherwise this is a null pointer.
+  TimeReport *getTimeReport() { return time_report; }
+  void setTimeReport(TimeReport *report) { time_report = report; }
+  // Where spans are recorded for the trace-event file (-time-trace), if anywhere.
+  // Unlike the timing report, this is shared by every worker of a parallel run.
+  TimeTrace *getTimeTrace() { return time_trace; }
+  void setTimeTrace(TimeTrace *trace) { time_trace = trace; }
+  // Where the current module's statistics are counted while they are being kept
+  // (-stats-json). Otherwise this is a null pointer.
+  TranslationStats *getStats() { return stats; }
+  void setStats(TranslationStats *module_stats) { stats = module_stats; }
+  // Where the time spent on each declaration and macro is recorded while looking for
+  // the slowest ones (-profile-decls). Shared by every worker of a parallel run.
+  DeclProfile *getDeclProfile() { return decl_profile; }
+  void setDeclProfile(DeclProfile *profile) { decl_profile = profile; }
+  // Where warnings are collected (see CToFTypeFormatter::Report). If this is a
+  // null pointer, they go straight to standard error.
+  Diagnostics *getDiagnostics() { return diagnostics; }
+  void setDiagnostics(Diagnostics *diags) { diagnostics = diags; }
+  // Where translated types are remembered while the AST they belong to is being
+  // translated. Otherwise this is a null pointer and nothing is remembered.
+  TypeCache *getTypeCache() { return type_cache; }
+  void setTypeCache(TypeCache *cache) { type_cache = cache; }
+  // How many bytes of function interfaces are held in memory before they are moved
+  // to a temporary file (see DeferredOutput). Zero means the default.
+  size_t getSpillLimit() { return spill_limit; }
+  void setSpillLimit(size_t limit) { spill_limit = limit; }
+  // Describes every option which can change the translated text (but not the
+  // warnings) as a string, so that cached translations are only reused under
+  // the same options.
+  string getFlagsString() {
+    string flags;
+    flags += no_system_headers ? "n" : "-";
+    flags += together ? "t" : "-";
+    flags += array_transpose ? "a" : "-";
+    flags += auto_bind ? "b" : "-";
+    flags += hide_macros ? "h" : "-";
+    for (int i = 0; i <= CToFTypeFormatter::BAD_ARRAY; i++) {
+      flags += should_ignore[i] ? "1" : "0";
+    }
+    return flags;
+  }
   
 private:
   // Where to send translated Fortran code
@@ -243,6 +624,30 @@ private:
   // The module name may be altered during processing by the action;
   // by default this is an empty string. It is used to pass values out, not in.
   string module_name;
+  // Where translations are sorted by file during a single-parse run (not owned).
+  ModuleSplitter *splitter;
+  // If this isn't a null pointer, translations go here instead of the output file.
+  raw_ostream *output_redirect;
+  // Records all identifiers declared. This used to be a static set inside the guard,
+  // but copies of the arguments are given to each worker during a parallel run
+  // (-j) so each needs a table of its own.
+  SymbolTable symbols;
+  // Where duplicate identifier checks are logged, if anywhere (not owned).
+  GuardLog *guard_log;
+  // Where phases are timed, if anywhere (not owned).
+  TimeReport *time_report;
+  // Where spans are recorded, if anywhere (not owned).
+  TimeTrace *time_trace;
+  // Where statistics are counted, if anywhere (not owned).
+  TranslationStats *stats;
+  // Where declarations are profiled, if anywhere (not owned).
+  DeclProfile *decl_profile;
+  // Where warnings are collected, if anywhere (not owned).
+  Diagnostics *diagnostics;
+  // Where translated types are remembered, if anywhere (not owned).
+  TypeCache *type_cache;
+  // When function interfaces are moved to a temporary file, or zero for the default.
+  size_t spill_limit;
 };
 
 
@@ -270,8 +675,12 @@ public:
   // exists, "false" is returned. Otherwise "true" is returned.
   // It is in this class because originally it was only used
   // on structures and typedefs (the most common offenders).
-  // This reasoning is now historical.
-  static bool StructAndTypedefGuard(string name);
+  // This reasoning is now historical. The names seen are kept
+  // in the arguments' symbol table, by module. kind (ie "typedef")
+  // and sloc are recorded for the name if it is new. If it isn't,
+  // original is set to a description of what declared it first.
+  static bool StructAndTypedefGuard(string name, Arguments &args, const char *kind,
+      PresumedLoc sloc, string &original);
 
 private:
   // Rewriters are used, typically, to make small changes to the
@@ -372,6 +781,15 @@ public:
   PresumedLoc getSloc() { return sloc; }
 
 private:
+  // Whether the type is translated as a CHARACTER, so that its values are written as
+  // character literals. Only plain char is. Signed and unsigned char (and int8_t and
+  // uint8_t) are INTEGERs, though Clang calls them all char types.
+  bool isCharacter(QualType qt);
+  // Writes the value of one of Clang's char types for an initializer: a literal ('a')
+  // if it is a CHARACTER, otherwise an integer. Fortran has no unsigned kinds, so an
+  // unsigned char too large for its kind is written with the same bits (200 is -56).
+  static string getCharValueASString(const APSInt &value, bool is_character);
+
   Rewriter &rewriter;
   // Used to store information about the shape of an array declaration.
   string arrayShapes_fin;
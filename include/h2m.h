@@ -10,6 +10,524 @@
 // translate C to Fortran.
 #include "formatters.h"
 
+//------------Single-parse helper class decl----------------------------------------------------------------------------------------
+
+// During a single-parse recursive run (-single-parse) the whole include tree is
+// parsed once, as one translation unit, instead of once for every header. The
+// visitor and the macro callbacks do not write their translations straight to the
+// output in this case. Instead, they sort them by the file they came from into
+// the buffers kept here. The main program then writes each file's buffers out as
+// a module, in the order recorded by TraceFiles during that same parse.
+class ModuleSplitter {
+public:
+  // The translated text from one file. The body holds everything but the functions,
+  // in the order it was seen. The functions are kept separately so that they can be
+  // wrapped in a single INTERFACE at the end of the module, as usual.
+  struct FileText {
+    string body;
+    string functions;
+  };
+
+  // Finds the name of the file the given location belongs to, exactly as TraceFiles
+  // records it, so that the translations can be matched up with the traced order.
+  // Locations inside macro expansions are attributed to the file where the expansion
+  // occurs. An empty string is returned for invalid locations and for the <built-in>
+  // and <command line> buffers, which are not real files.
+  static string getFileName(SourceLocation loc, SourceManager &sm);
+  // Fetches the buffers for the named file, creating them if none exist yet.
+  FileText &getFileText(const string &filename) { return files[filename]; }
+
+  // The file changes seen by the preprocessor, recorded by TraceFiles. This is
+  // sorted into the translation order exactly like a normal recursive run's stack.
+  std::stack<string> stackfiles;
+
+private:
+  // Translated text for each file seen, by file name.
+  std::map<string, FileText> files;
+};
+
+// The translation of a single header during a normal recursive run. The module's
+// text is held here until every module before it has been written, because the
+// USE statements at the top of the module depend on whether those earlier
+// translations succeeded. The main program writes the boiler plate around the
+// body once that is known.
+struct ModuleTranslation {
+  // The header to translate and the name already chosen for its module.
+  string headerfile;
+  string module_name;
+  // Everything which belongs between the boiler plate at the start and the end
+  // of the module: macros, declarations and the interface of functions.
+  string body;
+  // If set, the body is written straight to this stream (the output file) as it is
+  // translated instead of being kept above, and the boiler plate around it, which
+  // USEs the modules given, is written with it. Only possible when nothing needs
+  // the body afterwards: no cache or manifest, no worker and no ONLY lists.
+  raw_ostream *direct = nullptr;
+  string use_modules;
+  // Whether the source file was begun at all. If it wasn't, there is no module.
+  bool started = false;
+  // The value returned by the clang tool run on this header.
+  int tool_errors = 0;
+  // Every file the translation of this header read (the header itself, the files
+  // it includes and so on), as opened. Used to validate cached translations.
+  std::set<string> dependencies;
+  // Counts kept for the statistics file (-stats-json). A module which came out of
+  // the translation cache only counts the bytes written.
+  TranslationStats stats;
+  // Whether the body came out of the translation cache rather than a tool run.
+  bool from_cache = false;
+  // The identifiers this module declared first (folded, see SymbolTable), for
+  // the ModuleIndex.
+  std::vector<string> declared;
+};
+
+// The index of a recursive run, built as the modules are written: which module
+// declares each identifier. It is used to write the USE statements at the top of
+// each module, naming only the modules the module refers to and, with ONLY, just
+// the identifiers it refers to. This keeps the Fortran compiler from loading every
+// earlier module (and importing everything in them) for each module in a deep tree.
+// With use_all (-use-all-modules), every module instead USEs all the modules before
+// it, without ONLY, as h2m used to do.
+class ModuleIndex {
+public:
+  ModuleIndex(bool use_all = false) : use_all(use_all) {}
+  // Records a module just written and the names it declares. If a name has been
+  // declared by an earlier module, that is the one used. linked is false if the
+  // module had translation errors, so USE statements for it are to be commented out.
+  void AddModule(const string &module_name, const std::vector<string> &declared,
+      bool linked);
+  // Builds the USE statements for a module about to be written whose text (the
+  // part between the boiler plate) is given, in as many pieces as need be. Only
+  // the names a declaration can take from another module are looked at (see
+  // FindReferences). Names the module declares itself are left out. Long
+  // statements are continued.
+  string UseStatements(ArrayRef<StringRef> texts,
+      const std::vector<string> &declared) const;
+
+private:
+  struct Module {
+    string name;
+    bool linked;
+  };
+  // Adds the identifiers the text refers to to needed, by the module declaring them.
+  void FindReferences(StringRef text, const StringSet<> &own,
+      std::map<unsigned, std::set<string>> &needed) const;
+
+  bool use_all;
+  // In the order written, which is the order their USE statements go in.
+  std::vector<Module> modules;
+  // The module declaring each identifier, by its place in modules.
+  StringMap<unsigned> owners;
+};
+
+//------------Translation cache class decl----------------------------------------------------------------------------------------
+
+// A persistent cache of translated modules, kept on disk in a directory given
+// with -cache-dir. An entry is found by a key made from the header's name and
+// contents, the options which affect translation, the Clang version and the
+// command line. Each entry then records the contents of every file the
+// translation read, and every duplicate identifier check it made, so that an
+// entry is only used if a new translation would produce exactly the same text.
+// Only the body of a module is cached. The boiler plate, including the USE
+// statements, is always written fresh by the main program.
+class TranslationCache {
+public:
+  // With is_manifest false, the location is a directory of entries (-cache-dir).
+  // Otherwise it is a single manifest file, read here and written by SaveManifest,
+  // which holds one entry per header of a recursive run (-incremental).
+  TranslationCache(string location, IntrusiveRefCntPtr<CachingFileSystem> fs,
+      bool is_manifest = false);
+
+  // Makes the key of the cache entry for translating the given header.
+  string getKey(const string &headerfile, Arguments &args,
+      CompilationDatabase &Compilations, const std::vector<string> &extra_args);
+  // If there is a valid entry for the key, its body and dependencies are copied into
+  // the translation and its identifiers are added to those seen in the arguments.
+  // A manifest's entry must also have been made for the same header and module name.
+  bool Lookup(const string &key, ModuleTranslation &translation, Arguments &args);
+  // Writes an entry for a successful translation. Failures are only warned about.
+  void Store(const string &key, const ModuleTranslation &translation,
+      const GuardLog &log, Arguments &args);
+  // Replaces the manifest with the entries looked up or stored during this run.
+  bool SaveManifest(Arguments &args);
+  // The MD5 hash of a file's contents in hex, or an empty string if it can't be read.
+  string HashFile(const string &path);
+
+  unsigned getHits() { return hits; }
+  unsigned getMisses() { return misses; }
+
+private:
+  // Everything recorded about one translation.
+  struct Entry {
+    string header;
+    string module_name;
+    string key;
+    std::vector<std::pair<string, string>> dependencies;  // Hash and path
+    GuardLog log;
+    string body;
+  };
+  static bool ReadEntry(StringRef &rest, Entry &entry);
+  static string WriteEntry(const Entry &entry);
+  static bool WriteFileAtomically(const string &path, const string &contents);
+  bool UseEntry(const Entry &entry, ModuleTranslation &translation, Arguments &args);
+
+  // Where the entries are kept: a directory with one file each, named after their
+  // keys, or the manifest file.
+  string directory;
+  // File contents are read through the shared cache, which usually has them already.
+  IntrusiveRefCntPtr<CachingFileSystem> files;
+  bool manifest;
+  // The entries of the manifest as read, by header, and those to be written back.
+  std::map<string, Entry> old_entries;
+  std::map<string, Entry> new_entries;
+  std::mutex lock;
+  // Counts of entries used and not found (or not valid). Workers of a parallel
+  // run update these at the same time.
+  std::atomic<unsigned> hits{0};
+  std::atomic<unsigned> misses{0};
+};
+
+// Escapes a string for use inside quotes in JSON output.
+string EscapeJSON(const string &text);
+
+// Records spans of time during a run and writes them out as a Chrome trace-event
+// file (-time-trace), which can be opened in chrome://tracing or Perfetto to see
+// the whole run as a timeline. Each span is a complete ("X") event on the track of
+// the thread it was recorded on, so the workers of a parallel run each get a track.
+// Spans may be recorded from any thread.
+class TimeTrace {
+public:
+  // The thread making the trace gets the first track.
+  TimeTrace() : start(std::chrono::steady_clock::now()) {
+    threads[std::this_thread::get_id()] = 0;
+  }
+
+  // Records a span which began at the given time and ends now. The detail (ie the
+  // header or declaration the span was spent on) is shown with the span's name.
+  void AddSpan(const string &name, const string &detail,
+      std::chrono::steady_clock::time_point begin);
+  // Writes every span recorded so far to the file. False is returned on failure.
+  bool Write(const string &filename);
+
+  // Records a span lasting as long as this exists. Nothing is recorded without a
+  // trace. The detail is only worth working out if there is a trace to record it.
+  class Scope {
+  public:
+    Scope(TimeTrace *trace, const string &name, const string &detail = "") :
+        trace(trace) {
+      if (trace != nullptr) {
+        this->name = name;
+        this->detail = detail;
+        begin = std::chrono::steady_clock::now();
+      }
+    }
+    ~Scope() {
+      if (trace != nullptr) {
+        trace->AddSpan(name, detail, begin);
+      }
+    }
+  private:
+    TimeTrace *trace;
+    string name;
+    string detail;
+    std::chrono::steady_clock::time_point begin;
+  };
+
+private:
+  struct Span {
+    string name;
+    string detail;
+    long long begin;  // Microseconds since the trace started
+    long long duration;
+    unsigned thread;
+  };
+  std::chrono::steady_clock::time_point start;
+  std::vector<Span> spans;
+  // Threads are numbered in the order they record their first span.
+  std::map<std::thread::id, unsigned> threads;
+  std::mutex lock;
+};
+
+// Keeps the slowest declarations (and macros) translated during a run so that the
+// few which cost far more than the rest can be found (-profile-decls). Each is timed
+// from the start of its formatter through EmitTranslationAndErrors. Only the slowest
+// few are kept, in a heap whose smallest time is replaced when a slower one comes
+// along. Declarations may be added from any thread.
+class DeclProfile {
+public:
+  // Keeps the given number of declarations.
+  explicit DeclProfile(unsigned limit) : limit(limit) {}
+
+  // Records a declaration which began translating at the given time and is done
+  // now. Its location is copied, since the PresumedLoc dies with the tool run.
+  void Add(const char *kind, const string &name, PresumedLoc sloc, size_t bytes,
+      std::chrono::steady_clock::time_point begin);
+  // Prints the declarations kept, slowest first.
+  void Print(raw_ostream &out);
+
+  // Times the translation of a declaration for as long as this exists. The location
+  // and size of the text emitted are only known once the formatter is done, so they
+  // are given before this goes. Nothing is timed without a profile.
+  class Scope {
+  public:
+    Scope(DeclProfile *profile, const char *kind, const NamedDecl *decl) :
+        profile(profile), kind(kind) {
+      if (profile != nullptr) {
+        if (decl != nullptr) {
+          name = decl->getNameAsString();
+        }
+        begin = std::chrono::steady_clock::now();
+      }
+    }
+    Scope(DeclProfile *profile, const char *kind, StringRef macro_name) :
+        profile(profile), kind(kind) {
+      if (profile != nullptr) {
+        name = macro_name.str();
+        begin = std::chrono::steady_clock::now();
+      }
+    }
+    ~Scope() {
+      if (profile != nullptr) {
+        profile->Add(kind, name, sloc, bytes, begin);
+      }
+    }
+    // The location of the declaration and the size of the text emitted for it.
+    void setResult(PresumedLoc location, size_t size) {
+      sloc = location;
+      bytes = size;
+    }
+  private:
+    DeclProfile *profile;
+    const char *kind;
+    string name;
+    PresumedLoc sloc;
+    size_t bytes = 0;
+    std::chrono::steady_clock::time_point begin;
+  };
+
+private:
+  struct Entry {
+    double seconds;
+    string kind;
+    string name;
+    string location;  // file:line:column, or empty if it wasn't valid
+    size_t bytes;
+    // The heap is ordered to keep the fastest declaration on top.
+    bool operator>(const Entry &other) const { return seconds > other.seconds; }
+  };
+  unsigned limit;
+  // How many declarations were timed in all.
+  unsigned long long count = 0;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> slowest;
+  std::mutex lock;
+};
+
+// Times the phases of a run for the timing report (-time-report). There is one
+// TimerGroup with a Timer for every phase for the whole run, and another for each
+// header translated. Phases nest (the formatters run during the traversal, which
+// runs during the tool run) but each timer only counts the time spent in its own
+// phase, not in the phases inside it, so the times of a group add up. LLVM's timers
+// are not safe to use from several threads, so a timed run uses a single job.
+class TimeReport {
+public:
+  enum Phase {TRACE=0, PARSE=1, TRAVERSE=2, FUNCTION=3, VAR=4, RECORD=5, ENUM=6,
+      TYPEDEF=7, MACRO=8, EMIT=9, OUTPUT=10, NUM_PHASES=11};
+
+  TimeReport();
+  // Phases timed from now on are charged to this header as well as the totals.
+  void BeginHeader(const string &headerfile);
+  // Phases timed from now on are only charged to the totals.
+  void EndHeader();
+  // Starts or stops timing a phase. Phases must be stopped in the reverse of the
+  // order they were started in.
+  void Start(Phase phase);
+  void Stop(Phase phase);
+  // Prints the times for each header and then the totals.
+  void Print(raw_ostream &out);
+
+  // Times a phase for as long as it exists. Nothing is timed without a report.
+  class Scope {
+  public:
+    Scope(TimeReport *report, Phase phase) : report(report), phase(phase) {
+      if (report != nullptr) {
+        report->Start(phase);
+      }
+    }
+    ~Scope() {
+      if (report != nullptr) {
+        report->Stop(phase);
+      }
+    }
+  private:
+    TimeReport *report;
+    Phase phase;
+  };
+
+private:
+  // The timers are declared after their group so that they are destroyed first.
+  struct Group {
+    std::unique_ptr<TimerGroup> group;
+    std::vector<std::unique_ptr<Timer>> timers;
+  };
+  std::unique_ptr<Group> MakeGroup(const string &name, const string &description);
+  void StartTimers(Phase phase);
+  void StopTimers(Phase phase);
+
+  std::unique_ptr<Group> totals;
+  std::vector<std::unique_ptr<Group>> headers;
+  // The header's group being charged, if any.
+  Group *current = nullptr;
+  // The phases currently started, innermost last. Only the innermost is timing.
+  std::vector<Phase> running;
+};
+
+// Wraps the compilation database of a project (-p) so that the headers included by
+// its sources can be parsed on their own. A header is given the command of the first
+// source recorded as including it, with the source's name replaced by the header's.
+// Anything else is looked up in the project's database as usual. Headers must all be
+// added before any worker threads start looking up commands.
+class ProjectDatabase : public CompilationDatabase {
+public:
+  explicit ProjectDatabase(std::unique_ptr<CompilationDatabase> db) :
+      database(std::move(db)) {}
+
+  // Records that the header (an absolute path) is compiled like the given source,
+  // unless it has been recorded with a source already.
+  void AddHeader(const string &header, const string &source);
+
+  std::vector<CompileCommand> getCompileCommands(StringRef FilePath) const override;
+  std::vector<string> getAllFiles() const override {
+    return database->getAllFiles();
+  }
+  std::vector<CompileCommand> getAllCompileCommands() const override {
+    return database->getAllCompileCommands();
+  }
+
+private:
+  std::unique_ptr<CompilationDatabase> database;
+  std::map<string, string> header_sources;
+};
+
+// Records every file entered or skipped by the preprocessor during a translation so
+// that the translation cache can tell when any of them changes.
+class RecordDependencies : public PPCallbacks {
+public:
+  RecordDependencies(CompilerInstance &ci, std::set<string> &deps) :
+      ci(ci), dependencies(deps) {}
+
+  void FileChanged(clang::SourceLocation loc, clang::PPCallbacks::FileChangeReason reason,
+        clang::SrcMgr::CharacteristicKind filetype, clang::FileID prevfid) override {
+    if (reason != PPCallbacks::EnterFile || loc.isValid() == false) {
+      return;
+    }
+    SourceManager &sm = ci.getSourceManager();
+    const FileEntry *entry = sm.getFileEntryForID(sm.getFileID(sm.getExpansionLoc(loc)));
+    if (entry != nullptr) {  // The <built-in> buffer, for one, has no file.
+      dependencies.insert(entry->getName());
+    }
+  }
+
+  // A file skipped because of its include guard still matters. It was probably
+  // entered before, but it costs nothing to make sure.
+  void FileSkipped(const FileEntry &SkippedFile, const Token &FilenameTok,
+      SrcMgr::CharacteristicKind FileType) override {
+    dependencies.insert(SkippedFile.getName());
+  }
+
+private:
+  CompilerInstance &ci;
+  std::set<string> &dependencies;
+};
+
+//------------File system cache class decl----------------------------------------------------------------------------------------
+
+// A layer over the real file system which remembers the result of every stat and
+// the contents of every file read. One of these is shared by the tracing run and
+// every per-header run of a recursive translation, so the system and project
+// headers which every header includes are only looked up and read from disk once.
+// The lookups are guarded by a lock because the workers of a parallel run (-j)
+// share the cache. Files are assumed not to change while h2m is running.
+class CachingFileSystem : public vfs::FileSystem {
+public:
+  explicit CachingFileSystem(IntrusiveRefCntPtr<vfs::FileSystem> real_fs) :
+      real(real_fs) {}
+
+  // Answers from the cache if this path has been looked up before. Failed lookups
+  // are remembered as well, since include paths are searched by failing.
+  llvm::ErrorOr<vfs::Status> status(const Twine &Path) override;
+  // Hands out a file which reads from the cached contents of the real file.
+  llvm::ErrorOr<std::unique_ptr<vfs::File>> openFileForRead(const Twine &Path) override;
+  // Directory listings and the working directory are not cached.
+  vfs::directory_iterator dir_begin(const Twine &Dir, std::error_code &EC) override {
+    return real->dir_begin(Dir, EC);
+  }
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override {
+    return real->getCurrentWorkingDirectory();
+  }
+  std::error_code setCurrentWorkingDirectory(const Twine &Path) override {
+    return real->setCurrentWorkingDirectory(Path);
+  }
+
+  // Counts of the requests sent on to the real file system and of those
+  // which were answered from the cache instead.
+  unsigned getRealStats() { return real_stats; }
+  unsigned getSavedStats() { return saved_stats; }
+  unsigned getRealReads() { return real_reads; }
+  unsigned getSavedReads() { return saved_reads; }
+
+private:
+  IntrusiveRefCntPtr<vfs::FileSystem> real;
+  // Guards the maps and the counts below.
+  std::mutex lock;
+  std::map<string, llvm::ErrorOr<vfs::Status>> stats;
+  std::map<string, std::unique_ptr<llvm::MemoryBuffer>> contents;
+  unsigned real_stats = 0;
+  unsigned saved_stats = 0;
+  unsigned real_reads = 0;
+  unsigned saved_reads = 0;
+};
+
+//------------Deferred output class decl----------------------------------------------------------------------------------------
+
+// Holds text which has to be written out later, such as the functions waiting to be
+// wrapped in the INTERFACE at the end of a module. The text is kept in fixed size
+// chunks so that appending to it never copies what is already there. Once more than
+// the spill limit is held, everything is moved to a temporary file and the rest is
+// written straight to that file. It is read back a chunk at a time, so when the
+// module goes straight to the output file (see ModuleTranslation::direct) this
+// bounds the memory used by a very large module (ie -together over thousands of
+// prototypes). If no temporary file can be made, the text simply stays in memory.
+class DeferredOutput : public raw_ostream {
+public:
+  static const size_t chunk_size = 64 * 1024;
+  static const size_t default_spill_limit = 16 * 1024 * 1024;
+
+  // Nothing is buffered by the stream itself. The chunks are the buffer.
+  explicit DeferredOutput(size_t limit = default_spill_limit) :
+      raw_ostream(true), spill_limit(limit) {}
+  ~DeferredOutput() override;
+  bool empty() const { return chunks.empty() && spill == nullptr; }
+  // Writes all the text held to out in the order it was written here and lets go of
+  // it. Returns false if the temporary file could not be written or read back.
+  bool WriteTo(raw_ostream &out);
+
+private:
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return position; }
+  // Moves the chunks to a new temporary file, if one can be made.
+  void Spill();
+  // Lets go of the chunks and removes the temporary file, if any.
+  void clear();
+
+  size_t spill_limit;
+  std::vector<std::unique_ptr<char[]>> chunks;
+  size_t last_used = 0;  // The bytes used in the last chunk
+  std::unique_ptr<raw_fd_ostream> spill;
+  SmallString<128> spill_path;
+  bool spill_failed = false;
+  uint64_t position = 0;
+};
+
 //------------Visitor class decl----------------------------------------------------------------------------------------------------
 
 // Main class which works to translate the C to Fortran by calling helpers.
@@ -20,32 +538,79 @@
 class TraverseNodeVisitor : public RecursiveASTVisitor<TraverseNodeVisitor> {
 public:
   TraverseNodeVisitor(Rewriter &R, Arguments& arg) :
-	  TheRewriter(R), args(arg) {}
+	  allFunctionDecls(arg.getSpillLimit() != 0 ? arg.getSpillLimit() :
+	  DeferredOutput::default_spill_limit), TheRewriter(R), args(arg) {}
 
   // Traverse all declaration nodes. Note that Clang AST nodes do NOT all have
   // a common ancestor. Decl and Stmt are essentially unrelated.
   bool TraverseDecl(Decl *d);
   bool TraverseStmt(Stmt *x);
   bool TraverseType(QualType x);
-  // All the function declarations processed so far in this AST are kept in 
-  // a string to be emitted later. This should be private -Michelle
-  string allFunctionDecls;
+  // All the function declarations processed so far in this AST are kept 
+  // to be emitted later. This should be private -Michelle
+  DeferredOutput allFunctionDecls;
 
 private:
+  // Decides whether a declaration should be translated. Normally, only declarations
+  // in the main file are translated unless -together was given. During a single-parse
+  // run, anything from a real file is translated, and that file's buffers are
+  // selected to receive the translation.
+  bool ShouldTranslate(Decl *d);
+  // Sends translated text (other than a function) to the output file, or to the
+  // selected file's buffer during a single-parse run.
+  void WriteTranslation(const string &text);
+  // Emits a formatter's translation (see EmitTranslationAndErrors) to wherever
+  // WriteTranslation would send it. A function is instead stored to be wrapped in
+  // the INTERFACE later on.
+  uint64_t EmitTranslation(CToFTypeFormatter::status status, const string &error_string,
+      const string &translation, PresumedLoc sloc, bool is_function);
+
   // This is no longer used for rewriting, only to get the SourceManager.
   Rewriter &TheRewriter;
   // Additional translation arguments (ie quiet/silent) from the action factory
   Arguments &args;
+  // The buffers of the file whose declaration is being translated during a
+  // single-parse run. This is a null pointer otherwise.
+  ModuleSplitter::FileText *current_file = nullptr;
+  // The location of the declaration being traversed, which is given for a type
+  // inside it (types have no location of their own).
+  SourceLocation decl_loc;
+};
+
+// The system headers seen while tracing a recursive run. These are what goes into
+// a precompiled system header (-system-pch), which the translation of every
+// project header then loads instead of parsing the system headers again.
+struct SystemIncludes {
+  // The system headers included directly by a non-system file, as spelled in
+  // the #include (ie <stdio.h>), in the order they were first seen.
+  std::vector<string> top_level;
+  // Every system header entered, directly or not, by presumed file name.
+  std::set<string> files;
 };
 
 // Traces the preprocessor as it moves through files and records the inclusions in a stack.
 // From the stack, the main program will be able to create an approximate order of 
 // dependencies in which to translate these files when making a recursive run.
 // Every time the preprocessor changes files, that new file is added onto the stack.
+// If a SystemIncludes is given, the system headers seen are also recorded there.
 class TraceFiles : public PPCallbacks {
 public:
-  TraceFiles(CompilerInstance &ci, std::stack<string>& filesstack, Arguments& arg) :
-  ci(ci), stackfiles(filesstack), args(arg) { }
+  TraceFiles(CompilerInstance &ci, std::stack<string>& filesstack, Arguments& arg,
+      SystemIncludes *sys = nullptr) :
+  ci(ci), stackfiles(filesstack), args(arg), system_includes(sys) { }
+
+  // Notes an angled #include in a non-system file. If the file it names turns out
+  // to be a system header when it is entered, it is a top level system include.
+  void InclusionDirective(SourceLocation HashLoc, const Token &IncludeTok,
+      StringRef FileName, bool IsAngled, CharSourceRange FilenameRange,
+      const FileEntry *File, StringRef SearchPath, StringRef RelativePath,
+      const clang::Module *Imported) override {
+    pending_include = "";
+    if (system_includes != nullptr && IsAngled == true &&
+        ci.getSourceManager().isInSystemHeader(HashLoc) == false) {
+      pending_include = "<" + FileName.str() + ">";
+    }
+  }
 
   // Writes into the stack if a new file is entered by the preprocessor.
   void FileChanged(clang::SourceLocation loc, clang::PPCallbacks::FileChangeReason reason,
@@ -55,7 +620,20 @@ public:
     // Before checking this, check that the location is valid at all.
     if (loc.isValid() == false) {
       return;  // We are not in a valid file. Don't include it. It's probably an error.    
-    } else if (ci.getSourceManager().isInSystemHeader(loc) == true &&
+    }
+    // Record the system headers before deciding whether to skip them.
+    if (system_includes != nullptr && reason == PPCallbacks::EnterFile) {
+      if (ci.getSourceManager().isInSystemHeader(loc) == true) {
+        system_includes->files.insert(ci.getSourceManager().getPresumedLoc(loc).getFilename());
+        if (pending_include.empty() == false &&
+            std::find(system_includes->top_level.begin(), system_includes->top_level.end(),
+            pending_include) == system_includes->top_level.end()) {
+          system_includes->top_level.push_back(pending_include);
+        }
+      }
+      pending_include = "";
+    }
+    if (ci.getSourceManager().isInSystemHeader(loc) == true &&
         args.getNoSystemHeaders() == true) {
       return;
     }
@@ -78,50 +656,41 @@ private:
   // Order data structure to keep track of the order the files were seen by the preprocessor.
   std::stack<string>& stackfiles;
   Arguments &args;
-};
-
-// This is a dummy class. See the explanation for the existence of
-// CreateHeaderStackAction::CreateASTConsumer.
-class InactiveNodeConsumer : public clang::ASTConsumer {
-public:
-  InactiveNodeConsumer() {}
-
-  // Intentionally does nothing. We're only using the preprocessor.
-  virtual void HandleTranslationUnit(clang::ASTContext &Context) {}
+  // Where system headers are recorded, if anywhere (may be a null pointer).
+  SystemIncludes *system_includes;
+  // The angled include most recently seen in a non-system file, waiting to see
+  // whether it leads into a system header.
+  string pending_include;
 };
 
 // This is the action to follow the preprocessor and create a stack of files to be 
 // used to determine the order in which to translate files during a recursive
-// run of the tool (who is liked to who by USE statements?).
-class CreateHeaderStackAction : public clang::ASTFrontendAction {
+// run of the tool (who is liked to who by USE statements?). Only the preprocessor
+// is run. There is no need to build an AST just to see which files are entered.
+// (A -single-parse run does its tracing during the translation's parse instead.)
+class CreateHeaderStackAction : public clang::PreprocessOnlyAction {
 public:
-  CreateHeaderStackAction(std::stack<string>& filesstack, Arguments &arg) :
-     stackfiles(filesstack), args(arg) {} 
+  CreateHeaderStackAction(std::stack<string>& filesstack, Arguments &arg,
+     SystemIncludes *sys) :
+     stackfiles(filesstack), args(arg), system_includes(sys) {} 
 
   // When a source file begins, the callback to trace filechanges is registered
   // so that all changes are recorded and the order of includes can be preserved
-  // in the stack.
+  // in the stack. The preprocessor then lexes through the whole file.
   bool BeginSourceFileAction(CompilerInstance &ci, StringRef Filename) override {
     Preprocessor &pp = ci.getPreprocessor();
-    pp.addPPCallbacks(llvm::make_unique<TraceFiles>(ci, stackfiles, args));
+    pp.addPPCallbacks(llvm::make_unique<TraceFiles>(ci, stackfiles, args,
+        system_includes));
     return true;
    }
 
-  // This is a dummy. For some reason or other, in order to get the action to
-  // work, I had to use an ASTFrontendAction (PreprocessorOnlyAction did not
-  // work) thus this method has to exist (it is pure virtual). If you 
-  // can get PreprocessorOnlyAction to work, feel free to fix this, otherwise just
-  // ignore it.
-  std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
-    clang::CompilerInstance &Compiler, llvm::StringRef InFile) override {
-    return llvm::make_unique<InactiveNodeConsumer>();
-  }
-
 private:
   // Keeps track of the order the headers were seen in
   std::stack<string>& stackfiles; 
   // Arguments passed in from the action factory
   Arguments &args;
+  // Where to record system headers, if anywhere (may be a null pointer)
+  SystemIncludes *system_includes;
 };
 
 // This is the factory to run the preliminary preprocessor file tracing action
@@ -129,13 +698,14 @@ private:
 // with the help or a set and a stack
 class CHSFrontendActionFactory : public FrontendActionFactory {
 public:
-  CHSFrontendActionFactory(std::stack<string>& stackfiles, Arguments &arg) :
-     stackfiles(stackfiles), args(arg) {} 
+  CHSFrontendActionFactory(std::stack<string>& stackfiles, Arguments &arg,
+     SystemIncludes *sys = nullptr) :
+     stackfiles(stackfiles), args(arg), system_includes(sys) {} 
 
   // Creates a new action which only attends to file changes in the preprocessor.
   // This allows tracing of the files included.
   CreateHeaderStackAction *create() override {
-    return new CreateHeaderStackAction(stackfiles, args);
+    return new CreateHeaderStackAction(stackfiles, args, system_includes);
   }
 
 private:
@@ -143,6 +713,39 @@ private:
   std::stack<string>& stackfiles;
   // Additional arguments, including quiet/silent and the module name
   Arguments &args;
+  // Where to record the system headers seen (only needed for -system-pch)
+  SystemIncludes *system_includes;
+};
+
+// Precompiles the system headers of a recursive run (-system-pch). The output
+// file is chosen by h2m rather than by the command line, which is meant for
+// the translation runs and knows nothing of precompiled headers.
+class SystemPCHAction : public clang::GeneratePCHAction {
+public:
+  explicit SystemPCHAction(string output) : output(output) {}
+
+protected:
+  bool BeginInvocation(CompilerInstance &ci) override {
+    ci.getFrontendOpts().OutputFile = output;
+    return true;
+  }
+
+private:
+  // Where the precompiled header should be written
+  string output;
+};
+
+// The factory for the precompiling action above.
+class SystemPCHFactory : public FrontendActionFactory {
+public:
+  explicit SystemPCHFactory(string output) : output(output) {}
+
+  SystemPCHAction *create() override {
+    return new SystemPCHAction(output);
+  }
+
+private:
+  string output;
 };
   
 // Classes, specifications, etc for the main translation program!
@@ -194,8 +797,11 @@ private:
 class TraverseNodeAction : public clang::ASTFrontendAction {
 public:
 
-  TraverseNodeAction(string to_use, Arguments &arg) :
-       use_modules(to_use), args(arg) {}
+  // If deferred is not a null pointer, no boiler plate is written. The action only
+  // records that the source file was begun there, and the main program adds the
+  // boiler plate itself later on.
+  TraverseNodeAction(string to_use, Arguments &arg, ModuleTranslation *deferred) :
+       use_modules(to_use), args(arg), deferred(deferred) {}
 
   // This function is used to paste boiler-plate needed at the beginning of
   // every Fortran module. Note that the prototype for this function was
@@ -208,6 +814,12 @@ public:
   // module.
   void EndSourceFileAction() override;
 
+  // These build the boiler-plate text at the beginning and end of every module.
+  // They are also used by the main program to write out the modules of a
+  // single-parse run, which never begins a source file for each module.
+  static string BeginModuleText(string module_name, string use_modules);
+  static string EndModuleText(string module_name);
+
   // Returns an AST consumer which does the majority of the translation work.
   // The AST consumer keeps track of how to handle the AST nodes (what functions to call)
   std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
@@ -227,6 +839,9 @@ private:
   string use_modules;
   // Additional arguments passed in from the action factory
   Arguments &args;
+  // Where the module's progress is recorded when the boiler plate is left to
+  // the main program (may be a null pointer).
+  ModuleTranslation *deferred;
 };
 
 // Clang tools run FrontendActionFactories which implement
@@ -237,13 +852,14 @@ private:
 // h2m action to translate C to Fortran.
 class TNAFrontendActionFactory : public FrontendActionFactory {
 public:
-  TNAFrontendActionFactory(string to_use, Arguments &arg) :
-     use_modules(to_use), args(arg) {};
+  TNAFrontendActionFactory(string to_use, Arguments &arg,
+     ModuleTranslation *deferred = nullptr) :
+     use_modules(to_use), args(arg), deferred(deferred) {};
 
   // Mandatory function to create a file's TNAction. This method
   // is called once for each file under consideration.
   TraverseNodeAction *create() override {
-    return new TraverseNodeAction(use_modules, args);
+    return new TraverseNodeAction(use_modules, args, deferred);
   }
 
 private:
@@ -252,6 +868,59 @@ private:
   string use_modules;
   // Additional arguments (ie quiet/silent)
   Arguments &args;
+  // Passed on to the action, see TraverseNodeAction
+  ModuleTranslation *deferred;
 };
 
+// This is the action for a single-parse recursive run. It traces the files seen by
+// the preprocessor (as CreateHeaderStackAction does) and translates the macros and
+// declarations of every file (as TraverseNodeAction does) during the same parse.
+// The translations are sorted into files by the ModuleSplitter in the arguments.
+// No module boilerplate is written here. The main program does that once the
+// translation order is known.
+class SingleParseAction : public clang::ASTFrontendAction {
+public:
+  SingleParseAction(ModuleSplitter &split, Arguments &arg) :
+     splitter(split), args(arg) {}
 
+  // Registers both the file tracing and the macro translating callbacks.
+  bool BeginSourceFileAction(CompilerInstance &ci, StringRef Filename) override {
+    Preprocessor &pp = ci.getPreprocessor();
+    pp.addPPCallbacks(llvm::make_unique<TraceFiles>(ci, splitter.stackfiles, args));
+    pp.addPPCallbacks(llvm::make_unique<TraverseMacros>(ci, args));
+    return true;
+  }
+
+  // The same consumer as a normal run. The visitor notices the splitter in
+  // the arguments and sorts its output accordingly.
+  std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
+    clang::CompilerInstance &Compiler, llvm::StringRef InFile) override {
+    TheRewriter.setSourceMgr(Compiler.getSourceManager(), Compiler.getLangOpts());
+    return llvm::make_unique<TraverseNodeConsumer>(TheRewriter, args);
+  }
+
+private:
+  // Only used to hand the SourceManager to the visitor.
+  Rewriter TheRewriter;
+  // Receives the order of the files and their translations.
+  ModuleSplitter &splitter;
+  // Additional arguments passed in from the action factory
+  Arguments &args;
+};
+
+// Factory for the single-parse action above. SP stands for "single parse."
+class SPFrontendActionFactory : public FrontendActionFactory {
+public:
+  SPFrontendActionFactory(ModuleSplitter &split, Arguments &arg) :
+     splitter(split), args(arg) {}
+
+  SingleParseAction *create() override {
+    return new SingleParseAction(splitter, args);
+  }
+
+private:
+  // Where the trace and translations from the parse are kept
+  ModuleSplitter &splitter;
+  // Additional arguments (ie quiet/silent)
+  Arguments &args;
+};
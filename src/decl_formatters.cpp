@@ -9,14 +9,14 @@
 // This results in duplicate-name-declaration errors in Fortran
 // because there are no seperate name-look-up procedures for
 // "tag-names" as there are in C (ie in C "typedef struct Point point"
-// is legal but in Fortran this causes conflicts.) A static map will
-// make sure that no typedef declares an already declared name.
-// If the name has already been seen, it returns false. If it hasn't,
-// it adds it to a set (will return false if called again with that
-// name) and returns true. It will also return true if the name is "".
-// This is assumed to be a mistake of some kind.
-bool RecordDeclFormatter::StructAndTypedefGuard(string name) {
-  static std::set<string> seennames;  // Records all identifiers seen.
+// is legal but in Fortran this causes conflicts.) A symbol table kept in the
+// Arguments will make sure that no typedef declares an already declared name
+// in the same module. If the name has already been seen, it returns false and
+// describes the original. If it hasn't, it adds it to the table (will return
+// false if called again with that name) and returns true. It will also return
+// true if the name is "". This is assumed to be a mistake of some kind.
+bool RecordDeclFormatter::StructAndTypedefGuard(string name, Arguments &args,
+    const char *kind, PresumedLoc sloc, string &original) {
   // This is insurance against accidental improper calling of
   // this function. No name is actually empty, so this can't be a
   // repeated name.
@@ -29,17 +29,18 @@ bool RecordDeclFormatter::StructAndTypedefGuard(string name) {
     name = "h2m" + name;
   }
   // Put the name into lowercase. Fortran is not case sensitive.
-  std::locale location;  // Determines if a lowercase exists
-  for (string::size_type j = 0; j < name.length(); j++) {
-    name[j] = std::tolower(name[j], location); 
+  SmallString<64> buffer;
+  StringRef folded = SymbolTable::Fold(name, buffer);
+  const SymbolTable::Symbol *first = args.getSymbols().Declare(folded, kind, sloc);
+  bool is_new = first == nullptr;
+  if (is_new == false) {
+    original = SymbolTable::Describe(*first);
   }
-  // If we have already added this file to the set... false
-  if (seennames.find(name) != seennames.end()) {
-    return false;
-  } else {  // Otherwise, add it to the stack and return true
-    seennames.insert(name);
-    return true;
+  // Record the check if the translation is to be cached.
+  if (args.getGuardLog() != nullptr) {
+    args.getGuardLog()->push_back(std::make_pair(folded.str(), is_new));
   }
+  return is_new;
 }
 
 // -----------initializer Typedef--------------------
@@ -54,8 +55,9 @@ TypedefDeclFormater::TypedefDeclFormater(TypedefDecl *t, Rewriter &r,
   // is always passed to a function which checks validity, this should 
   // be a fine way to guard against an invalid location.
   if (isLocValid) {
-    isInSystemHeader = rewriter.getSourceMgr().isInSystemHeader(
-        typedefDecl->getSourceRange().getBegin());
+    isInSystemHeader = CToFTypeFormatter::isExcludedSystemHeader(
+        typedefDecl->getSourceRange().getBegin(),
+        rewriter.getSourceMgr(), args);
     sloc = rewriter.getSourceMgr().getPresumedLoc(
         typedefDecl->getSourceRange().getBegin());
   }  
@@ -98,10 +100,9 @@ string TypedefDeclFormater::getFortranTypedefDeclASString() {
     }
     // Give a special warning about the odd way in which typedefs are made.
     if (args.getSilent() == false) {
-      errs() << "Warning: due to name collisions during typedef translation, " <<
-          identifier;
-      errs() <<  "\nrenamed " << identifier << "_" << type_no_wrapper << "\n";
-      CToFTypeFormatter::LineError(sloc);
+      CToFTypeFormatter::Warn(CToFTypeFormatter::RENAMED, "Warning: due to name "
+          "collisions during typedef translation, " + identifier + "\nrenamed " +
+          identifier + "_" + type_no_wrapper, sloc, args);
     }
     string modified_name = identifier + "_" + type_no_wrapper;
     string to_add = "    " + type_wrapper_name + "::" + modified_name + "\n";
@@ -110,20 +111,15 @@ string TypedefDeclFormater::getFortranTypedefDeclASString() {
       current_status = CToFTypeFormatter::BAD_NAME_LENGTH;
       error_string = modified_name;
     }
-    // Check for an illegal line length. Note that we add one to account for
-    // the newline character which shouldn't cound against line length.
-    if (to_add.length() > CToFTypeFormatter::line_max + 1) {
-      current_status = CToFTypeFormatter::BAD_LINE_LENGTH;
-      error_string = to_add;
-    }
     typedef_buffer += to_add;
     typedef_buffer += "END TYPE " + identifier + "\n";
     // Check to see whether we have declared something with this identifier before.
-    bool not_repeat = RecordDeclFormatter::StructAndTypedefGuard(identifier); 
+    string original;
+    bool not_repeat = RecordDeclFormatter::StructAndTypedefGuard(identifier, args,
+        "typedef", sloc, original); 
     if (not_repeat == false) {  // This indicates that this is a duplicate identifier.
       current_status = CToFTypeFormatter::DUPLICATE;
-      error_string = identifier + ", TYPEDEF.";
-      
+      error_string = identifier + ", TYPEDEF, " + original + ".";
     }
   } 
   return typedef_buffer;
@@ -141,8 +137,9 @@ EnumDeclFormatter::EnumDeclFormatter(EnumDecl *e, Rewriter &r,
   if (enumDecl->getSourceRange().getBegin().isValid()) {
     sloc = rewriter.getSourceMgr().getPresumedLoc(
         enumDecl->getSourceRange().getBegin());
-    isInSystemHeader = rewriter.getSourceMgr().isInSystemHeader(
-        enumDecl->getSourceRange().getBegin());
+    isInSystemHeader = CToFTypeFormatter::isExcludedSystemHeader(
+        enumDecl->getSourceRange().getBegin(),
+        rewriter.getSourceMgr(), args);
   } else {
     isInSystemHeader = false;  // If it isn't anywhere, it isn't in a system header
   }
@@ -207,9 +204,11 @@ string EnumDeclFormatter::getFortranEnumASString() {
       }
       // If there is a duplicate identifier, set the flag to reflect
       // the problem.
-      if (RecordDeclFormatter::StructAndTypedefGuard(constName) == false) { 
+      string original;
+      if (RecordDeclFormatter::StructAndTypedefGuard(constName, args, "enum member", sloc,
+          original) == false) { 
         current_status = CToFTypeFormatter::DUPLICATE;
-        error_string = constName + ", ENUM member.";
+        error_string = constName + ", ENUM member, " + original + ".";
       }
       enum_buffer += "ENUMERATOR :: " + constName + " = " + 
           std::to_string(constVal) + "\n";
@@ -238,8 +237,9 @@ RecordDeclFormatter::RecordDeclFormatter(RecordDecl* rd, Rewriter &r,
   if (recordDecl->getSourceRange().getBegin().isValid()) {
     sloc = rewriter.getSourceMgr().getPresumedLoc(
         recordDecl->getSourceRange().getBegin());
-    isInSystemHeader = rewriter.getSourceMgr().isInSystemHeader(
-        recordDecl->getSourceRange().getBegin());
+    isInSystemHeader = CToFTypeFormatter::isExcludedSystemHeader(
+        recordDecl->getSourceRange().getBegin(),
+        rewriter.getSourceMgr(), args);
   } else {
     isInSystemHeader = false;  // If it's not anywhere, it isn't in a system header
   }
@@ -312,8 +312,8 @@ string RecordDeclFormatter::getFortranStructASString() {
     if (fieldsInFortran.empty()) {  // Warn about an empty struct.
       rd_buffer = "! struct without fields may cause warnings\n";
       if (args.getSilent() == false && args.getQuiet() == false) {
-        errs() << "Warning: struct without fields may cause warnings: \n";
-        CToFTypeFormatter::LineError(sloc);
+        CToFTypeFormatter::Warn(CToFTypeFormatter::EMPTY_STRUCT,
+            "Warning: struct without fields may cause warnings: ", sloc, args);
       }
     }
    
@@ -387,10 +387,12 @@ string RecordDeclFormatter::getFortranStructASString() {
     // first line cannot be too long unless the identifier is hopelessly too long.
 
     // Check to see whether we have declared something with this identifier before.
-    bool not_repeat = RecordDeclFormatter::StructAndTypedefGuard(identifier); 
+    string original;
+    bool not_repeat = RecordDeclFormatter::StructAndTypedefGuard(identifier, args,
+        "structured type", sloc, original); 
     if (not_repeat == false) {  // This indicates a duplicate
       current_status = CToFTypeFormatter::DUPLICATE;
-      error_string = identifier + ", structured type.";
+      error_string = identifier + ", structured type, " + original + ".";
     }
     // Check for a name which is too long. 
     if (identifier.length() > CToFTypeFormatter::name_max) {
@@ -0,0 +1,54 @@
+// This file contains the DeclProfile class for the h2m translator.
+// It keeps the slowest declarations translated during a run and
+// reports them at the end (-profile-decls).
+
+#include "h2m.h"
+
+void DeclProfile::Add(const char *kind, const string &name, PresumedLoc sloc,
+    size_t bytes, std::chrono::steady_clock::time_point begin) {
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  std::lock_guard<std::mutex> guard(lock);
+  count++;
+  // Only make an entry if it is going to be kept.
+  if (limit == 0 || (slowest.size() == limit && elapsed.count() <= slowest.top().seconds)) {
+    return;
+  }
+  Entry entry;
+  entry.seconds = elapsed.count();
+  entry.kind = kind;
+  entry.name = name;
+  if (sloc.isValid()) {
+    entry.location = string(sloc.getFilename()) + ":" + std::to_string(sloc.getLine()) +
+        ":" + std::to_string(sloc.getColumn());
+  }
+  entry.bytes = bytes;
+  if (slowest.size() == limit) {
+    slowest.pop();
+  }
+  slowest.push(entry);
+}
+
+// The heap gives the declarations fastest first, so they are reversed to print.
+void DeclProfile::Print(raw_ostream &out) {
+  std::lock_guard<std::mutex> guard(lock);
+  std::vector<Entry> entries;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> copy = slowest;
+  while (copy.empty() == false) {
+    entries.push_back(copy.top());
+    copy.pop();
+  }
+  std::reverse(entries.begin(), entries.end());
+  out << "===" << string(73, '-') << "===\n";
+  out << "  Slowest declarations: " << entries.size() << " of " << count << " translated\n";
+  out << "===" << string(73, '-') << "===\n";
+  out << "   Time (ms)       Bytes  Kind          Name (Location)\n";
+  for (const Entry &entry : entries) {
+    out << format("%12.3f  %10zu  ", entry.seconds * 1000.0, entry.bytes);
+    out << left_justify(entry.kind, 12) << "  " << entry.name;
+    if (entry.location.empty() == false) {
+      out << " (" << entry.location << ")";
+    }
+    out << "\n";
+  }
+  out << "\n";
+}
@@ -0,0 +1,94 @@
+// This file contains the DeferredOutput class for the h2m translator.
+// It holds text to be written out later in chunks, moving it to a
+// temporary file once there is too much of it to keep in memory.
+
+#include "h2m.h"
+
+DeferredOutput::~DeferredOutput() {
+  flush();
+  clear();
+}
+
+void DeferredOutput::write_impl(const char *ptr, size_t size) {
+  position += size;
+  if (spill != nullptr) {  // The file stream does its own buffering.
+    spill->write(ptr, size);
+    return;
+  }
+  while (size > 0) {
+    if (chunks.empty() == true || last_used == chunk_size) {
+      chunks.emplace_back(new char[chunk_size]);
+      last_used = 0;
+    }
+    size_t copied = std::min(size, chunk_size - last_used);
+    memcpy(chunks.back().get() + last_used, ptr, copied);
+    last_used += copied;
+    ptr += copied;
+    size -= copied;
+  }
+  if (spill_failed == false && chunks.size() * chunk_size > spill_limit) {
+    Spill();
+  }
+}
+
+// If the file can't be made, we try no more and keep everything in memory.
+void DeferredOutput::Spill() {
+  int fd;
+  if (sys::fs::createTemporaryFile("h2m_deferred", "f90", fd, spill_path)) {
+    spill_failed = true;
+    return;
+  }
+  spill = llvm::make_unique<raw_fd_ostream>(fd, true);
+  for (size_t i = 0; i < chunks.size(); i++) {
+    spill->write(chunks[i].get(), i + 1 == chunks.size() ? last_used : chunk_size);
+  }
+  chunks.clear();
+  last_used = 0;
+}
+
+bool DeferredOutput::WriteTo(raw_ostream &out) {
+  bool okay = true;
+  if (spill != nullptr) {
+    spill->close();
+    // The file stream would otherwise report its error fatally when destroyed.
+    if (spill->has_error() == true) {
+      spill->clear_error();
+      okay = false;
+    } else {
+      // Read back a chunk at a time so that the text is never all in memory at once.
+      FILE *text = fopen(spill_path.c_str(), "rb");
+      if (text == nullptr) {
+        okay = false;
+      } else {
+        std::unique_ptr<char[]> piece(new char[chunk_size]);
+        size_t size;
+        while ((size = fread(piece.get(), 1, chunk_size, text)) > 0) {
+          out.write(piece.get(), size);
+        }
+        if (ferror(text) != 0) {
+          okay = false;
+        }
+        fclose(text);
+      }
+    }
+  }
+  // The chunks only hold text when nothing was spilled.
+  for (size_t i = 0; i < chunks.size(); i++) {
+    out.write(chunks[i].get(), i + 1 == chunks.size() ? last_used : chunk_size);
+  }
+  clear();
+  return okay;
+}
+
+void DeferredOutput::clear() {
+  chunks.clear();
+  last_used = 0;
+  if (spill != nullptr) {
+    if (spill->has_error() == true) {
+      spill->clear_error();
+    }
+    spill.reset();
+    sys::fs::remove(spill_path);
+    spill_path.clear();
+  }
+}
@@ -0,0 +1,146 @@
+// This file contains the Diagnostics class for the h2m translator.
+// It collects the warnings raised during a run, buffers them for
+// standard error and writes them out as JSON or SARIF (-diagnostics-file).
+
+#include "h2m.h"
+
+// Escapes a string for use inside quotes in JSON. This is used for all the
+// JSON h2m writes. It lives here because the formatters write JSON as well.
+string EscapeJSON(const string &text) {
+  string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char hex[8];
+      snprintf(hex, sizeof(hex), "\\u%04x", c);
+      escaped += hex;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+void Diagnostics::Report(CToFTypeFormatter::status status, const string &message,
+    PresumedLoc sloc) {
+  Add(TranslationStats::getStatusName(status),
+      status == CToFTypeFormatter::CRIT_ERROR ? "error" : "warning", message, sloc);
+}
+
+void Diagnostics::Warn(const char *rule, const string &message, PresumedLoc sloc) {
+  Add(rule, "warning", message, sloc);
+}
+
+// The text is the same as the old errs() and LineError pair gave. Two different
+// warnings with the same hash would only lose the second one, which is rare enough
+// to be worth not keeping every message of a long run.
+void Diagnostics::Add(const char *rule, const char *level, const string &message,
+    PresumedLoc sloc) {
+  Record record;
+  record.rule = rule;
+  record.level = level;
+  record.line = 0;
+  record.column = 0;
+  record.count = 1;
+  if (sloc.isValid()) {
+    record.file = sloc.getFilename();
+    record.line = sloc.getLine();
+    record.column = sloc.getColumn();
+  }
+  size_t key = hash_combine(StringRef(rule), record.file, record.line, record.column,
+      message);
+
+  std::lock_guard<std::mutex> guard(lock);
+  reported++;
+  std::unordered_map<size_t, unsigned>::iterator found = seen.find(key);
+  if (found != seen.end()) {  // A repeat is only counted.
+    repeats++;
+    if (keep_records == true) {
+      records[found->second].count++;
+    }
+    return;
+  }
+  seen[key] = records.size();
+  text += message;
+  text += "\n";
+  if (sloc.isValid()) {
+    text += record.file + " Line " + std::to_string(record.line) + "\n";
+  } else {
+    text += "Invalid file location \n";
+  }
+  if (keep_records == true) {
+    record.message = message;
+    records.push_back(record);
+  }
+  if (text.size() >= flush_size) {
+    errs() << text;
+    text.clear();
+  }
+}
+
+void Diagnostics::Flush() {
+  std::lock_guard<std::mutex> guard(lock);
+  if (text.empty() == false) {
+    errs() << text;
+    text.clear();
+  }
+}
+
+// The JSON is a single object with the records in the order they were first
+// reported. The SARIF is a log of one run with one rule per status or warning
+// rule seen.
+bool Diagnostics::WriteFile(const string &path, Format format) {
+  std::error_code error;
+  raw_fd_ostream out(path, error, sys::fs::F_Text);
+  if (error) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  if (format == JSON) {
+    out << "{\n  \"reported\": " << reported << ",\n  \"repeats\": " << repeats;
+    out << ",\n  \"diagnostics\": [";
+    for (size_t i = 0; i < records.size(); i++) {
+      const Record &record = records[i];
+      out << (i == 0 ? "\n" : ",\n") << "    {\"rule\": \"" << record.rule << "\", ";
+      out << "\"message\": \"" << EscapeJSON(record.message) << "\", ";
+      out << "\"file\": \"" << EscapeJSON(record.file) << "\", ";
+      out << "\"line\": " << record.line << ", \"column\": " << record.column << ", ";
+      out << "\"count\": " << record.count << "}";
+    }
+    out << "\n  ]\n}\n";
+  } else {
+    std::set<string> rules;
+    for (const Record &record : records) {
+      rules.insert(record.rule);
+    }
+    out << "{\n  \"$schema\": \"https://json.schemastore.org/sarif-2.1.0.json\",\n";
+    out << "  \"version\": \"2.1.0\",\n  \"runs\": [\n    {\n";
+    out << "      \"tool\": {\"driver\": {\"name\": \"h2m\", \"rules\": [";
+    bool first = true;
+    for (const string &rule : rules) {
+      out << (first ? "" : ", ") << "{\"id\": \"" << rule << "\"}";
+      first = false;
+    }
+    out << "]}},\n      \"results\": [";
+    for (size_t i = 0; i < records.size(); i++) {
+      const Record &record = records[i];
+      out << (i == 0 ? "\n" : ",\n") << "        {\"ruleId\": \"" << record.rule << "\", ";
+      out << "\"level\": \"" << record.level << "\", ";
+      out << "\"message\": {\"text\": \"" << EscapeJSON(record.message) << "\"}, ";
+      // A location which was invalid is left out altogether.
+      if (record.file.empty() == false) {
+        out << "\"locations\": [{\"physicalLocation\": {\"artifactLocation\": {\"uri\": \"" <<
+            EscapeJSON(record.file) << "\"}, \"region\": {\"startLine\": " << record.line;
+        out << ", \"startColumn\": " << record.column << "}}}], ";
+      }
+      out << "\"properties\": {\"count\": " << record.count << "}}";
+    }
+    out << "\n      ]\n    }\n  ]\n}\n";
+  }
+  out.close();
+  bool failed = out.has_error();
+  out.clear_error();
+  return failed == false;
+}
@@ -0,0 +1,92 @@
+// This file contains the CachingFileSystem class for the h2m
+// translator. It keeps the repeated tool runs of a recursive
+// translation from going back to the disk for the same files.
+
+#include "h2m.h"
+
+// A file whose contents have already been read into memory by the cache.
+// Buffers handed out only refer to the cached contents, which live as
+// long as the cache itself does.
+class CachedFile : public vfs::File {
+public:
+  CachedFile(vfs::Status stat, const llvm::MemoryBuffer &buffer) :
+      stat(stat), buffer(buffer) {}
+
+  llvm::ErrorOr<vfs::Status> status() override { return stat; }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> getBuffer(const Twine &Name,
+      int64_t FileSize, bool RequiresNullTerminator, bool IsVolatile) override {
+    return llvm::MemoryBuffer::getMemBuffer(buffer.getBuffer(), Name.str(),
+        RequiresNullTerminator);
+  }
+
+  std::error_code close() override { return std::error_code(); }
+
+private:
+  vfs::Status stat;
+  const llvm::MemoryBuffer &buffer;
+};
+
+// Looks a path up in the cache, asking the real file system only the first time.
+// The real file system is asked without holding the lock. If two workers ask for
+// the same path at once, both go to the disk and the first answer is kept.
+llvm::ErrorOr<vfs::Status> CachingFileSystem::status(const Twine &Path) {
+  string path = Path.str();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto found = stats.find(path);
+    if (found != stats.end()) {
+      saved_stats++;
+      return found->second;
+    }
+  }
+  llvm::ErrorOr<vfs::Status> result = real->status(path);
+  std::lock_guard<std::mutex> guard(lock);
+  real_stats++;
+  return stats.insert(std::make_pair(path, result)).first->second;
+}
+
+// Reads the whole file the first time it is opened and keeps the contents.
+// Every later open of the same path is answered from memory.
+llvm::ErrorOr<std::unique_ptr<vfs::File>> CachingFileSystem::openFileForRead(
+    const Twine &Path) {
+  string path = Path.str();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto found = contents.find(path);
+    auto found_stat = stats.find(path);
+    if (found != contents.end() && found_stat != stats.end() && found_stat->second) {
+      saved_reads++;
+      return std::unique_ptr<vfs::File>(new CachedFile(*found_stat->second,
+          *found->second));
+    }
+  }
+  // Not seen yet (or only stat'd). Open and read the real file.
+  llvm::ErrorOr<std::unique_ptr<vfs::File>> file = real->openFileForRead(path);
+  if (!file) {
+    return file;  // Failures to open are not remembered. They are rare.
+  }
+  llvm::ErrorOr<vfs::Status> stat = (*file)->status();
+  if (!stat) {
+    return stat.getError();
+  }
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = (*file)->getBuffer(path);
+  if (!buffer) {
+    return buffer.getError();
+  }
+  (*file)->close();
+
+  std::lock_guard<std::mutex> guard(lock);
+  real_reads++;
+  // The status of an opened file is the most reliable one we can get. It replaces
+  // whatever an earlier stat may have found.
+  auto stat_entry = stats.find(path);
+  if (stat_entry != stats.end()) {
+    stat_entry->second = stat;
+  } else {
+    stats.insert(std::make_pair(path, stat));
+  }
+  // If another worker read the file at the same time, keep the first copy.
+  auto content_entry = contents.insert(std::make_pair(path, std::move(*buffer))).first;
+  return std::unique_ptr<vfs::File>(new CachedFile(*stat, *content_entry->second));
+}
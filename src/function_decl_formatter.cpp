@@ -16,8 +16,9 @@ FunctionDeclFormatter::FunctionDeclFormatter(FunctionDecl *f, Rewriter &r,
   if (funcDecl->getSourceRange().getBegin().isValid()) {
     sloc = rewriter.getSourceMgr().getPresumedLoc(
         funcDecl->getSourceRange().getBegin());
-    isInSystemHeader = rewriter.getSourceMgr().isInSystemHeader(
-        funcDecl->getSourceRange().getBegin());
+    isInSystemHeader = CToFTypeFormatter::isExcludedSystemHeader(
+        funcDecl->getSourceRange().getBegin(),
+        rewriter.getSourceMgr(), args);
   } else {
     isInSystemHeader = false;  // If it isn't anywhere, it isn't in a system header
   }
@@ -204,7 +205,8 @@ bool FunctionDeclFormatter::argLocValid() {
 // must also decide what sorts of iso_c_binding to use and relies
 // on helpers to obtain names and types of arguments.
 string FunctionDeclFormatter::getFortranFunctDeclASString() {
-  string fortranFunctDecl;
+  // The buffer keeps track of its lines (and their lengths) as it is built.
+  LineBuffer fortranFunctDecl;
   // This prevents sytem headers from leaking into the translation. It also
   // keeps out invalid arugment locations.
   if (!isInSystemHeader && argLocValid()) {
@@ -264,18 +266,16 @@ string FunctionDeclFormatter::getFortranFunctDeclASString() {
       string bodyText = Lexer::getSourceText(CharSourceRange::getTokenRange(
           stmt->getSourceRange()),
           sm, LangOptions(), 0);
-      string commentedBody;
-      std::istringstream in(bodyText);
+      size_t first_line = fortranFunctDecl.getLineCount();
+      fortranFunctDecl.appendCommentedOut(bodyText);
       // Unless told to be silent or quiet, inform the user that the
       // lines have been commented out.
-      for (std::string line; std::getline(in, line);) {
-        if (args.getQuiet() == false && args.getSilent() == false) {
-          errs() << "Warning: line " << line << " commented out \n";
-          CToFTypeFormatter::LineError(sloc);
+      if (args.getQuiet() == false && args.getSilent() == false) {
+        for (size_t i = first_line; i < fortranFunctDecl.getLineCount(); i++) {
+          CToFTypeFormatter::Warn(CToFTypeFormatter::COMMENTED_OUT, "Warning: line " +
+              fortranFunctDecl.getLine(i).drop_front(2).str() + " commented out ", sloc, args);
         }
-        commentedBody += "! " + line + "\n";
       }
-      fortranFunctDecl += commentedBody;
 
     }
     // Close the function or subroutine as appropriate.
@@ -288,25 +288,17 @@ string FunctionDeclFormatter::getFortranFunctDeclASString() {
     // The guard function checks for duplicate identifiers. This might 
     // happen because C is case sensitive. It shouldn't happen often, but if
     // it does, the duplicate declaration needs to be commented out.
-    bool duplicate = RecordDeclFormatter::StructAndTypedefGuard(funcname); 
+    string original;
+    bool duplicate = RecordDeclFormatter::StructAndTypedefGuard(funcname, args, "function",
+        sloc, original); 
     if (duplicate == false) {  // This implies this is a repeat.
       current_status = CToFTypeFormatter::DUPLICATE;
-      error_string = funcname + ", function name.";
-    }
-
-    // We check the line lengths in one place to make sure they are
-    // all valid fortran lengths.
-    std::istringstream in(fortranFunctDecl);
-    for (std::string line; std::getline(in, line);) {
-      // Trim the line to the point where a comment begins if it does.
-      line = line.substr(0, line.find_first_of("!"));
-      if (line.length() > CToFTypeFormatter::line_max) {
-        current_status = CToFTypeFormatter::BAD_LINE_LENGTH; 
-        error_string = line + ", in function.";
-      }
+      error_string = funcname + ", function name, " + original + ".";
     }
+    // Line lengths are not checked here. Over long lines are continued as the
+    // translation is written out (see TranslationWriter).
   }
 
-  return fortranFunctDecl;
+  return fortranFunctDecl.str();
 };
 
@@ -51,6 +51,25 @@ string Arguments::GenerateModuleName(string Filename) {
   return filename;
 }
 
+// Finds the presumed file name of a location in the same form TraceFiles records it.
+// Macro expansions are attributed to the file in which they are expanded.
+string ModuleSplitter::getFileName(SourceLocation loc, SourceManager &sm) {
+  if (loc.isValid() == false) {
+    return "";  // Nowhere in particular, it can't belong to any module.
+  }
+  PresumedLoc ploc = sm.getPresumedLoc(sm.getExpansionLoc(loc));
+  if (ploc.isInvalid()) {
+    return "";
+  }
+  string filename = ploc.getFilename();
+  // These are not real files and are never traced, see TraceFiles::FileChanged.
+  if (filename.find("<built-in>") != string::npos ||
+      filename.find("<command line>") != string::npos) {
+    return "";
+  }
+  return filename;
+}
+
 // Command line options: aliases are also provided. These are all part of one category.
 
 // Apply a custom category to all command-line options so that they are the
@@ -67,7 +86,8 @@ static cl::extrahelp CommonHelp(CommonOptionsParser::HelpMessage);
 static cl::extrahelp MoreHelp("\nSee README.txt for more information on h2m behavior.\n");
 
 // Positional parameter: the first input parameter should be the compilation file. 
-// Currently, h2m is only designed to take one file at a time.
+// Only one can be given here, since everything after it is passed on to Clang.
+// More inputs can be listed in a batch file (see -batch).
 static cl::opt<string> SourcePaths(cl::Positional, cl::cat(h2mOpts), cl::desc("<source0>"));
 
 // Output file, option is -out or -o.
@@ -76,6 +96,15 @@ static cl::opt<string> OutputFile("out", cl::init(""), cl::cat(h2mOpts),
 static cl::alias OutputFile2("o", cl::desc("Alias for -out"), cl::cat(h2mOpts), 
     cl::aliasopt(OutputFile));
 
+// A file listing more headers to translate in the same run, one per line. Each is
+// translated into a file of its own in the output directory.
+static cl::opt<string> BatchFile("batch", cl::cat(h2mOpts),
+    cl::desc("File listing more input files to translate, one per line"));
+
+// The directory in which each input's translation is written as <name>.f90.
+static cl::opt<string> OutDir("out-dir", cl::cat(h2mOpts),
+    cl::desc("Directory for the output files of a batch run"));
+
 // Boolean option to recursively process includes. The default is not to recursively process.
 static cl::opt<bool> Recursive("recursive", cl::cat(h2mOpts),
     cl::desc("Include other header files recursively via USE statements"));
@@ -154,6 +183,74 @@ static cl::opt<bool> LinkAll("link-all", cl::cat(h2mOpts),
 static cl::alias LinkAll2("l", cl::cat(h2mOpts), cl::desc("Alias for -link-all"),
     cl::aliasopt(LinkAll));
 
+// USE every earlier module in each module of a recursive run, rather than USE... ONLY
+// the identifiers it refers to, so that every name is passed on to later modules.
+static cl::opt<bool> UseAllModules("use-all-modules", cl::cat(h2mOpts),
+    cl::desc("USE every earlier module during a recursive run, not only what is needed"));
+
+// Parse the whole include tree once during a recursive run and split the translation
+// into modules by file, rather than parsing every header seperately.
+static cl::opt<bool> SingleParse("single-parse", cl::cat(h2mOpts),
+    cl::desc("Parse only once during a recursive run, splitting modules by file"));
+
+// The build directory of a project, holding its compilation database. Every header
+// included by the project's sources is translated with that source's flags.
+static cl::opt<string> BuildPath("p", cl::cat(h2mOpts),
+    cl::desc("Build directory holding a compilation database (compile_commands.json)"));
+
+// A regular expression choosing which headers of a project run are translated.
+static cl::opt<string> HeaderFilter("header-filter", cl::cat(h2mOpts),
+    cl::desc("Only translate the project headers whose paths match this regular expression"));
+
+// The number of headers to translate at the same time during a recursive run.
+static cl::opt<unsigned> Jobs("jobs", cl::init(1), cl::cat(h2mOpts),
+    cl::desc("Number of headers to translate at once during a recursive run (0 for all cores)"));
+static cl::alias Jobs2("j", cl::cat(h2mOpts), cl::desc("Alias for -jobs"),
+    cl::aliasopt(Jobs));
+
+// A directory in which to keep a precompiled header of the system headers used by a
+// recursive run. No directory means nothing is precompiled.
+static cl::opt<string> SystemPCH("system-pch", cl::cat(h2mOpts),
+    cl::desc("Directory in which to build and reuse precompiled system headers"));
+
+// Report the time spent in each phase of the run, for each header and in total.
+static cl::opt<bool> TimeReportOpt("time-report", cl::cat(h2mOpts),
+    cl::desc("Report the time spent in each phase of the translation"));
+
+// A file to which a Chrome trace-event timeline of the whole run is written.
+static cl::opt<string> TimeTraceFile("time-trace", cl::cat(h2mOpts),
+    cl::desc("Write a Chrome trace-event (JSON) timeline of the run to this file"));
+
+// Report this many of the slowest declarations translated, with where they are.
+static cl::opt<unsigned> ProfileDecls("profile-decls", cl::init(0), cl::cat(h2mOpts),
+    cl::desc("Report the N slowest declarations and macros translated"),
+    cl::value_desc("N"));
+
+// Write counts of what was translated, skipped and commented out as JSON next to the output.
+static cl::opt<bool> StatsJSON("stats-json", cl::cat(h2mOpts),
+    cl::desc("Write translation statistics to <output>.stats.json"));
+
+// A file to which every warning raised during the run is written as JSON or SARIF.
+static cl::opt<string> DiagnosticsFile("diagnostics-file", cl::cat(h2mOpts),
+    cl::desc("Write the warnings raised during the run to this file"));
+static cl::opt<string> DiagnosticsFormat("diagnostics-format", cl::init("json"),
+    cl::cat(h2mOpts), cl::desc("Format of the diagnostics file: json or sarif"));
+
+// A directory in which to keep translated modules for reuse by later runs.
+static cl::opt<string> CacheDir("cache-dir", cl::cat(h2mOpts),
+    cl::desc("Directory in which to cache translated modules for later runs"));
+
+// Keep a manifest of what each module of a recursive run was translated from next to
+// the output file so that the next run only translates the headers which changed.
+static cl::opt<bool> Incremental("incremental", cl::cat(h2mOpts),
+    cl::desc("Only re-translate the headers changed since the last recursive run"));
+
+// How much of the function interfaces to hold in memory before moving them to a
+// temporary file. Mostly useful for testing that this works.
+static cl::opt<unsigned> SpillLimit("spill-limit", cl::init(0), cl::cat(h2mOpts),
+    cl::desc("Bytes of function interfaces held in memory before using a temporary file"),
+    cl::value_desc("bytes"));
+
 // These five options define requets to NOT comment out errors which h2m
 // normal checks for. The five error types to be ignored if their respective
 // options are turned on are: BAD_NAME_LENGTH, BAD_LINE_LENGTH, BAD_TYPE,
@@ -161,7 +258,7 @@ static cl::alias LinkAll2("l", cl::cat(h2mOpts), cl::desc("Alias for -link-all")
 static cl::opt<bool> IgnoreName("ignore-name-length", cl::cat(h2mOpts),
     cl::desc("Do not comment out illegally long names"));
 static cl::opt<bool> IgnoreLine("ignore-line-length", cl::cat(h2mOpts),
-    cl::desc("Do not comment out illegally long lines"));
+    cl::desc("Do not comment out illegally long lines which could not be split"));
 static cl::opt<bool> IgnoreType("ignore-type", cl::cat(h2mOpts),
     cl::desc("Do not comment out unrecognized types"));
 static cl::opt<bool> IgnoreAnon("ignore-anon", cl::cat(h2mOpts),
@@ -178,6 +275,34 @@ static cl::opt<string> other(cl::ConsumeAfter, cl::desc("Front end arguments"));
 // This function does the work of determining what the node currently under traversal
 // is and creating the proper object-translation object to handle it.
 bool TraverseNodeVisitor::TraverseDecl(Decl *d) {
+  // During a timed run, the time spent here (outside of the formatters) is recorded.
+  TimeReport *report = args.getTimeReport();
+  TimeReport::Scope traverse_time(report, TimeReport::TRAVERSE);
+  // The trace shows which declaration the time went to. This is done for every
+  // declaration, so the names are only built when there is a trace.
+  TimeTrace *trace = args.getTimeTrace();
+  NamedDecl *named = dyn_cast<NamedDecl>(d);
+  TimeTrace::Scope traverse_span(trace,
+      trace != nullptr ? string("TraverseDecl ") + d->getDeclKindName() : string(),
+      trace != nullptr && named != nullptr ? named->getNameAsString() : string());
+  // While statistics are kept, count the declaration and whether it is skipped.
+  TranslationStats *stats = args.getStats();
+  // While profiling, each declaration translated is timed along with its formatter.
+  DeclProfile *profile = args.getDeclProfile();
+  if (stats != nullptr && isa<TranslationUnitDecl>(d) == false) {
+    stats->declarations[d->getDeclKindName()]++;
+    if (ShouldTranslate(d) == false) {
+      stats->skipped_not_main++;
+    } else if (CToFTypeFormatter::isExcludedSystemHeader(d->getLocStart(),
+        TheRewriter.getSourceMgr(), args) == true) {
+      stats->skipped_system++;
+    }
+  }
+  // Types have no location of their own, so their warnings give the declaration's.
+  SourceLocation outer_loc = decl_loc;
+  if (d->getLocation().isValid()) {
+    decl_loc = d->getLocation();
+  }
   // Handle all the potential declarations which might appear
   // in a header file.
   if (isa<TranslationUnitDecl> (d)) {
@@ -191,9 +316,10 @@ bool TraverseNodeVisitor::TraverseDecl(Decl *d) {
     // Function checks for that.
     // Note that, if the option Together is specified, the entire AST (save
     // for system headers which are checked for elsewhere) is sent to the
-    // same file due to the || statement
-    if (TheRewriter.getSourceMgr().isInMainFile(d->getLocation()) ||
-        args.getTogether() == true) {
+    // same file (see ShouldTranslate).
+    if (ShouldTranslate(d) == true) {
+      DeclProfile::Scope decl_cost(profile, "Function", named);
+      TimeReport::Scope formatter_time(report, TimeReport::FUNCTION);
       FunctionDeclFormatter fdf(cast<FunctionDecl> (d), TheRewriter, args);
       string function_raw = fdf.getFortranFunctDeclASString();
       // Functions are put at the end of the module and are stored as a 
@@ -202,97 +328,180 @@ bool TraverseNodeVisitor::TraverseDecl(Decl *d) {
       // status and string returned by the translation object, taking into 
       // acount arguments, to determine what errors (if any) to print and
       // whether the translated text should be emitted at all.
-      allFunctionDecls += CToFTypeFormatter::EmitTranslationAndErrors(fdf.getStatus(),
-          fdf.getErrorString(), function_raw, fdf.getSloc(), args);
+      TimeReport::Scope emit_time(report, TimeReport::EMIT);
+      decl_cost.setResult(fdf.getSloc(), EmitTranslation(fdf.getStatus(),
+          fdf.getErrorString(), function_raw, fdf.getSloc(), true));
     }
     
   } else if (isa<TypedefDecl> (d)) {
     // Keep included header files out of the mix by checking the location.
     // If we are asked to provide all includes together in one module,
     // do so (the second boolean takes care of this).
-    if (TheRewriter.getSourceMgr().isInMainFile(d->getLocation()) ||
-        args.getTogether() == true) {
+    if (ShouldTranslate(d) == true) {
+      DeclProfile::Scope decl_cost(profile, "Typedef", named);
+      TimeReport::Scope formatter_time(report, TimeReport::TYPEDEF);
       TypedefDecl *tdd = cast<TypedefDecl> (d);
       TypedefDeclFormater tdf(tdd, TheRewriter, args);
       string typedef_raw = tdf.getFortranTypedefDeclASString();
       // Determine whether to comment out text and what errors to print
       // if any.
-      args.getOutput().os() << CToFTypeFormatter::EmitTranslationAndErrors(tdf.getStatus(),
-          tdf.getErrorString(), typedef_raw, tdf.getSloc(), args);
+      TimeReport::Scope emit_time(report, TimeReport::EMIT);
+      decl_cost.setResult(tdf.getSloc(), EmitTranslation(tdf.getStatus(),
+          tdf.getErrorString(), typedef_raw, tdf.getSloc(), false));
     }
 
   } else if (isa<RecordDecl> (d)) {
     // Keep included header files out of the mix by checking the location
     // Record decls are things like structs and unions.
     // Handle a request to put all code in one module as usual.
-    if (TheRewriter.getSourceMgr().isInMainFile(d->getLocation()) ||
-        args.getTogether() == true) {
+    if (ShouldTranslate(d) == true) {
+      DeclProfile::Scope decl_cost(profile, "Record", named);
+      TimeReport::Scope formatter_time(report, TimeReport::RECORD);
       RecordDecl *rd = cast<RecordDecl> (d);
       RecordDeclFormatter rdf(rd, TheRewriter, args);
       string raw_record = rdf.getFortranStructASString();
-      args.getOutput().os() << CToFTypeFormatter::EmitTranslationAndErrors(rdf.getStatus(),
-          rdf.getErrorString(), raw_record, rdf.getSloc(), args);
+      TimeReport::Scope emit_time(report, TimeReport::EMIT);
+      decl_cost.setResult(rdf.getSloc(), EmitTranslation(rdf.getStatus(),
+          rdf.getErrorString(), raw_record, rdf.getSloc(), false));
     }
 
   } else if (isa<VarDecl> (d)) {
     // Keep included header files out of the mix by checking the location
     // Any kind of variable (function pointers, structs, ints, etc)
     // is a vardecl when declared.
-    if (TheRewriter.getSourceMgr().isInMainFile(d->getLocation()) ||
-        args.getTogether() == true) {
+    if (ShouldTranslate(d) == true) {
+      DeclProfile::Scope decl_cost(profile, "Var", named);
+      TimeReport::Scope formatter_time(report, TimeReport::VAR);
       VarDecl *varDecl = cast<VarDecl> (d);
       VarDeclFormatter vdf(varDecl, TheRewriter, args);
       string raw_decl = vdf.getFortranVarDeclASString();
-      args.getOutput().os() << CToFTypeFormatter::EmitTranslationAndErrors(vdf.getStatus(),
-        vdf.getErrorString(), raw_decl, vdf.getSloc(), args);
+      TimeReport::Scope emit_time(report, TimeReport::EMIT);
+      decl_cost.setResult(vdf.getSloc(), EmitTranslation(vdf.getStatus(),
+          vdf.getErrorString(), raw_decl, vdf.getSloc(), false));
     } 
 
   } else if (isa<EnumDecl> (d)) {
     // Keep included header files out of the mix by checking the location
-    if (TheRewriter.getSourceMgr().isInMainFile(d->getLocation()) ||
-        args.getTogether() == true) {
+    if (ShouldTranslate(d) == true) {
+      DeclProfile::Scope decl_cost(profile, "Enum", named);
+      TimeReport::Scope formatter_time(report, TimeReport::ENUM);
       EnumDeclFormatter edf(cast<EnumDecl> (d), TheRewriter, args);
       string raw_enum = edf.getFortranEnumASString();
-      args.getOutput().os() << CToFTypeFormatter::EmitTranslationAndErrors(edf.getStatus(),
-         edf.getErrorString(), raw_enum, edf.getSloc(), args);
+      TimeReport::Scope emit_time(report, TimeReport::EMIT);
+      decl_cost.setResult(edf.getSloc(), EmitTranslation(edf.getStatus(),
+          edf.getErrorString(), raw_enum, edf.getSloc(), false));
     }
   } else {
     // The program doesn't know what to do with this node yet.
     // Keep included header files out of the mix by checking the location
-    if (TheRewriter.getSourceMgr().isInMainFile(d->getLocation()) ||
-        args.getTogether() == true) {
-      errs() << "Unknown declaration discovered. Dumping declaration to file.\n";
-      args.getOutput().os() << "!found other type of declaration \n";
-      d->dump();
+    if (ShouldTranslate(d) == true) {
+      if (args.getSilent() == false) {
+        CToFTypeFormatter::Warn(CToFTypeFormatter::UNKNOWN_DECL, string("Warning: ") +
+            "unknown declaration (" + d->getDeclKindName() + ") commented out. " +
+            "Dumping declaration to standard error.",
+            TheRewriter.getSourceMgr().getPresumedLoc(d->getLocation()), args);
+        d->dump();
+      }
+      WriteTranslation("!found other type of declaration \n");
       RecursiveASTVisitor<TraverseNodeVisitor>::TraverseDecl(d);
     }
   }
 
+  decl_loc = outer_loc;
   return true; // Return false to stop the AST analyzing
 
 };
 
+// Decides whether the declaration should be translated at all in this run and,
+// during a single-parse run, which file's buffers the translation belongs in.
+bool TraverseNodeVisitor::ShouldTranslate(Decl *d) {
+  ModuleSplitter *splitter = args.getSplitter();
+  // Note that, if the option Together is specified, the entire AST (save
+  // for system headers which are checked for elsewhere) is sent to the
+  // same file due to the || statement
+  if (splitter == nullptr) {
+    return TheRewriter.getSourceMgr().isInMainFile(d->getLocation()) ||
+        args.getTogether() == true;
+  }
+  // A single-parse run translates everything. Declarations which do not belong
+  // to a real file (ie builtins) have no module to go in, so they are skipped.
+  string filename = ModuleSplitter::getFileName(d->getLocation(),
+      TheRewriter.getSourceMgr());
+  if (filename.empty() == true) {
+    current_file = nullptr;
+    return false;
+  }
+  current_file = &splitter->getFileText(filename);
+  // Each file becomes its own module, so its names are checked against its own.
+  args.getSymbols().setScope(filename);
+  return true;
+}
+
+// Sends a translation to the output file, or into the current file's module
+// during a single-parse run. 
+void TraverseNodeVisitor::WriteTranslation(const string &text) {
+  if (args.getSplitter() == nullptr) {
+    args.getOutputStream() << text;
+  } else if (current_file != nullptr) {
+    current_file->body += text;
+  }  // Otherwise there is no module this text could go in. It is dropped.
+}
+
+// Passes a formatter's translation through EmitTranslationAndErrors straight to
+// where WriteTranslation would send it, so the (possibly commented out) text is
+// never copied into a string of its own first. The number of characters written
+// is returned.
+uint64_t TraverseNodeVisitor::EmitTranslation(CToFTypeFormatter::status status,
+    const string &error_string, const string &translation, PresumedLoc sloc,
+    bool is_function) {
+  if (args.getSplitter() != nullptr) {
+    if (current_file == nullptr) {
+      return 0;  // There is no module this text could go in. It is dropped.
+    }
+    string &buffer = is_function ? current_file->functions : current_file->body;
+    size_t before = buffer.size();
+    raw_string_ostream out(buffer);
+    CToFTypeFormatter::EmitTranslationAndErrors(status, error_string, translation, sloc,
+        args, out);
+    out.flush();
+    return buffer.size() - before;
+  }
+  // Functions are put at the end of the module and are stored in chunks
+  // (or a temporary file, if there are enough of them) until they are emitted.
+  if (is_function == true) {
+    uint64_t before = allFunctionDecls.tell();
+    CToFTypeFormatter::EmitTranslationAndErrors(status, error_string, translation, sloc,
+        args, allFunctionDecls);
+    return allFunctionDecls.tell() - before;
+  }
+  raw_ostream &out = args.getOutputStream();
+  uint64_t before = out.tell();
+  CToFTypeFormatter::EmitTranslationAndErrors(status, error_string, translation, sloc,
+      args, out);
+  return out.tell() - before;
+}
+
 
 // Currently, there are no attempts made to traverse and translate statements into 
 // Fortran. This method simply comments out statements and warns about them if
 // necessary.
 bool TraverseNodeVisitor::TraverseStmt(Stmt *x) {
-  string stmtText;
+  LineBuffer stmtText;
   // Get the statement text from the Lexer.
   string stmtSrc = Lexer::getSourceText(CharSourceRange::getTokenRange(x->getLocStart(), 
       x->getLocEnd()), TheRewriter.getSourceMgr(), LangOptions(), 0);
-  // comment out stmtText using a string stream to add ! after every newline
-  std::istringstream in(stmtSrc);
-  for (std::string line; std::getline(in, line);) {
-    // Output warnings about commented out statements only if a loud run is in progress.
-    if (args.getQuiet() == false && args.getSilent() == false) {
-      errs() << "Warning: statement " << stmtText << " commented out.\n";
-      CToFTypeFormatter::LineError(TheRewriter.getSourceMgr().getPresumedLoc(x->getLocStart()));
+  // comment out stmtText by adding ! at the start of every line
+  stmtText.appendCommentedOut(stmtSrc);
+  // Output warnings about commented out statements only if a loud run is in progress.
+  if (args.getQuiet() == false && args.getSilent() == false) {
+    for (size_t i = 0; i < stmtText.getLineCount(); i++) {
+      CToFTypeFormatter::Warn(CToFTypeFormatter::COMMENTED_OUT, "Warning: statement " +
+          stmtText.getLine(i).drop_front(2).str() + " commented out.",
+          TheRewriter.getSourceMgr().getPresumedLoc(x->getLocStart()), args);
     }
-    stmtText += "! " + line + "\n";
   }
   // Output the commented out text into the translated file.
-  args.getOutput().os() << stmtText;
+  WriteTranslation(stmtText.str());
 
   RecursiveASTVisitor<TraverseNodeVisitor>::TraverseStmt(x);
   // Continue traversing the AST.
@@ -304,9 +513,11 @@ bool TraverseNodeVisitor::TraverseStmt(Stmt *x) {
 // These are believed to always be one line long.
 bool TraverseNodeVisitor::TraverseType(QualType x) {
   string qt_string = "!" + x.getAsString();
-  args.getOutput().os() << qt_string;
+  WriteTranslation(qt_string);
   if (args.getQuiet() == false && args.getSilent() == false) { 
-    errs() << "Warning: type " << qt_string << " commented out.\n";
+    CToFTypeFormatter::Warn(CToFTypeFormatter::COMMENTED_OUT, "Warning: type " +
+        qt_string + " commented out.", TheRewriter.getSourceMgr().getPresumedLoc(decl_loc),
+        args);
   }
   RecursiveASTVisitor<TraverseNodeVisitor>::TraverseType(x);
   // Continue traversing the AST
@@ -319,10 +530,48 @@ bool TraverseNodeVisitor::TraverseType(QualType x) {
 // function will then determine what errors to emit (if any) given the
 // object's status, and whether to comment out the text.
 void TraverseMacros::MacroDefined (const Token &MacroNameTok, const MacroDirective *MD) {
+    DeclProfile::Scope macro_cost(args.getDeclProfile(), "Macro",
+        MacroNameTok.getIdentifierInfo()->getName());
+    TimeReport::Scope formatter_time(args.getTimeReport(), TimeReport::MACRO);
+    TimeTrace::Scope macro_span(args.getTimeTrace(), "MacroDefined",
+        args.getTimeTrace() != nullptr ? MacroNameTok.getIdentifierInfo()->getName().str() : "");
+    // During a single-parse run, the macro goes with the file defining it, if there
+    // is one, and its name is checked against that file's module.
+    ModuleSplitter *splitter = args.getSplitter();
+    string filename;
+    if (splitter != nullptr) {
+      filename = ModuleSplitter::getFileName(MD->getMacroInfo()->getDefinitionLoc(),
+          ci.getSourceManager());
+      args.getSymbols().setScope(filename);
+    }
     MacroFormatter mf(MacroNameTok, MD, ci, args);
     string raw_macro = mf.getFortranMacroASString();
-    args.getOutput().os() << CToFTypeFormatter::EmitTranslationAndErrors(mf.getStatus(),
-      mf.getErrorString(), raw_macro, mf.getSloc(), args);
+    // The translation is written straight to where it belongs.
+    raw_ostream *out = &args.getOutputStream();
+    raw_null_ostream dropped;
+    std::unique_ptr<raw_string_ostream> file_out;
+    if (splitter != nullptr) {
+      if (filename.empty() == false) {
+        file_out.reset(new raw_string_ostream(splitter->getFileText(filename).body));
+        out = file_out.get();
+      } else {
+        out = &dropped;
+      }
+    }
+    uint64_t written = out->tell();
+    {
+      TimeReport::Scope emit_time(args.getTimeReport(), TimeReport::EMIT);
+      CToFTypeFormatter::EmitTranslationAndErrors(mf.getStatus(), mf.getErrorString(),
+          raw_macro, mf.getSloc(), args, *out);
+    }
+    written = out->tell() - written;
+    macro_cost.setResult(mf.getSloc(), written);
+    if (args.getStats() != nullptr) {
+      args.getStats()->macros_processed++;
+      if (written > 0) {
+        args.getStats()->macros_emitted++;
+      }
+    }
 }
 
 // HandlTranslationUnit is the overarching entry into the clang ast which is
@@ -331,15 +580,22 @@ void TraverseNodeConsumer::HandleTranslationUnit(clang::ASTContext &Context) {
 // Traversing the translation unit decl via a RecursiveASTVisitor
 // will visit all nodes in the AST.
 
+  // The types translated are remembered for as long as this AST is around.
+  TypeCache type_cache(Context);
+  args.setTypeCache(&type_cache);
   Visitor.TraverseDecl(Context.getTranslationUnitDecl());
+  args.setTypeCache(nullptr);
 
   // wrap all func decls in a single interface. The Visitor
-  // has kept track of functions in string form, waiting to
-  // output them all at once.
+  // has kept track of functions, waiting to output them all at once.
   if (!Visitor.allFunctionDecls.empty()) {
-    args.getOutput().os() << "INTERFACE\n" 
-    << Visitor.allFunctionDecls
-    << "END INTERFACE\n";   
+    raw_ostream &out = args.getOutputStream();
+    out << "INTERFACE\n";
+    if (Visitor.allFunctionDecls.WriteTo(out) == false) {
+      errs() << "Error: unable to read back the functions held in a temporary file. ";
+      errs() << "The INTERFACE is incomplete.\n";
+    }
+    out << "END INTERFACE\n";
   }
 }
 
@@ -348,16 +604,26 @@ void TraverseNodeConsumer::HandleTranslationUnit(clang::ASTContext &Context) {
 bool TraverseNodeAction::BeginSourceFileAction(CompilerInstance &ci, StringRef Filename)
 {
   fullPathFileName = Filename;
-  // We have to pass this back out to keep track of repeated module names
-  args.GenerateModuleName(Filename);
+  if (deferred != nullptr) {
+    // The name was chosen by the main program in advance and the main program
+    // will write the boiler plate once it knows what to USE, unless it already
+    // knows and the module goes straight to the output.
+    deferred->started = true;
+    args.setModuleName(deferred->module_name);
+    if (deferred->direct != nullptr) {
+      args.getOutputStream() << BeginModuleText(deferred->module_name,
+          deferred->use_modules);
+    }
+    // Keep track of what the translation reads in case it is to be cached.
+    ci.getPreprocessor().addPPCallbacks(llvm::make_unique<RecordDependencies>(ci,
+        deferred->dependencies));
+  } else {
+    // We have to pass this back out to keep track of repeated module names
+    args.GenerateModuleName(Filename);
 
-  // initalize Module and imports
-  string beginSourceModule;
-  beginSourceModule = "MODULE " + args.getModuleName() + "\n";
-  beginSourceModule += "USE, INTRINSIC :: iso_c_binding\n";
-  beginSourceModule += use_modules;
-  beginSourceModule += "implicit none\n";
-  args.getOutput().os() << beginSourceModule;
+    // initalize Module and imports
+    args.getOutputStream() << BeginModuleText(args.getModuleName(), use_modules);
+  }
 
   // Arrange for the preprocessor to record the definitions of macros.
   Preprocessor &pp = ci.getPreprocessor();
@@ -368,10 +634,836 @@ bool TraverseNodeAction::BeginSourceFileAction(CompilerInstance &ci, StringRef F
 // Executed when a source file is finished. This allows the boiler plate required 
 // for the end of a fotran module to be added to the file.
 void TraverseNodeAction::EndSourceFileAction() {
-    string endSourceModule;
-    endSourceModule = "END MODULE " + args.getModuleName() + "\n";
-    args.getOutput().os() << endSourceModule;
+    // Otherwise the main program takes care of this.
+    if (deferred == nullptr || deferred->direct != nullptr) {
+      args.getOutputStream() << EndModuleText(args.getModuleName());
+    }
+  }
+
+// The boiler plate at the start of a module: its name, the intrinsic binding module
+// and any previously translated modules which should be USEd.
+string TraverseNodeAction::BeginModuleText(string module_name, string use_modules) {
+  string beginSourceModule;
+  beginSourceModule = "MODULE " + module_name + "\n";
+  beginSourceModule += "USE, INTRINSIC :: iso_c_binding\n";
+  beginSourceModule += use_modules;
+  beginSourceModule += "implicit none\n";
+  return beginSourceModule;
+}
+
+// The boiler plate at the end of a module.
+string TraverseNodeAction::EndModuleText(string module_name) {
+  string endSourceModule;
+  endSourceModule = "END MODULE " + module_name + "\n";
+  return endSourceModule;
+}
+
+// The algorithm for sorting the order is as follows:
+// 1. Every time the preprocessor changes to a new file, add that file to
+//    the top of a stack.
+// 2. Empty that stack. Every time a file is encountered for the first
+//    time, add it to the top of a new stack
+// 3. Use the new stack to give the translation order.
+// The stack passed in is emptied in the process.
+static std::stack<string> SortHeaderStack(std::stack<string> &stackfiles) {
+  // This set keeps track of which files have been seen so far.
+  std::set<string> setfiles;
+  std::stack<string> sorted_headers;  // Will hold the headers as we sort them.
+  while (stackfiles.empty() == false) {
+    string headerfile = stackfiles.top();
+    stackfiles.pop();
+
+    // If this is our first encounter with this file, meaning the "last" time
+    // the file was encountered during our traversal of the inclusion structure...
+    if (setfiles.find(headerfile) == setfiles.end()) {
+      sorted_headers.push(headerfile);  // Add it to the stack to reverse the order.
+      setfiles.insert(headerfile);  // We'll ignore this file if we see it again.
+    }
+  }  // We thus reverse the order so that the first file will be last.
+  return sorted_headers;
+}
+
+// Runs a tool action on a single file just as a ClangTool would, save that the
+// FileManager given is used rather than a new one. This allows the many tool runs
+// of a recursive translation to share what they have learned about the files on
+// disk. The return value is the same as that of ClangTool::run.
+// Any extra arguments given are added to the end of the command line.
+// A command run in a directory other than the current one (as those of a project's
+// compilation database may be) gets a FileManager of its own over the same file
+// system so that relative paths are found from the command's directory. A ClangTool
+// would change directory instead, but that can't be done with workers running.
+static int RunToolOnFile(CompilationDatabase &Compilations, string filename,
+    ToolAction *action, FileManager *files,
+    const std::vector<string> &extra_args = std::vector<string>()) {
+  // The executable's path is needed to find Clang's own headers (ie stddef.h).
+  static int StaticSymbol;
+  string executable = llvm::sys::fs::getMainExecutable("h2m", &StaticSymbol);
+  // These are the same adjustments a ClangTool makes by default.
+  ArgumentsAdjuster adjuster = combineAdjusters(getClangStripOutputAdjuster(),
+      getClangSyntaxOnlyAdjuster());
+  if (extra_args.empty() == false) {
+    adjuster = combineAdjusters(adjuster, getInsertArgumentAdjuster(extra_args,
+        ArgumentInsertPosition::END));
+  }
+
+  string path = getAbsolutePath(filename);
+  std::vector<CompileCommand> commands = Compilations.getCompileCommands(path);
+  if (commands.empty() == true) {
+    errs() << "Skipping " << path << ". Compile command not found.\n";
+    return(2);
   }
+  SmallString<256> current_directory;
+  sys::fs::current_path(current_directory);
+  int errors = 0;
+  for (CompileCommand &command : commands) {
+    std::vector<string> command_line = adjuster(command.CommandLine, command.Filename);
+    command_line[0] = executable;
+    FileManager *command_files = files;
+    std::unique_ptr<FileManager> own_files;
+    if (command.Directory.empty() == false && StringRef(command.Directory) != current_directory.str()) {
+      FileSystemOptions options;
+      options.WorkingDir = command.Directory;
+      own_files.reset(new FileManager(options, files->getVirtualFileSystem()));
+      command_files = own_files.get();
+    }
+    ToolInvocation invocation(std::move(command_line), action, command_files);
+    if (invocation.run() == false) {
+      errs() << "Error while processing " << path << ".\n";
+      errors = 1;
+    }
+  }
+  return(errors);
+}
+
+// Traces every source file in a project's compilation database in turn and lists the
+// headers they include in the order they should be translated. Each source's own
+// order is kept, and a header already listed for an earlier source is left out, so
+// every header still comes after everything it includes. The sources themselves are
+// not listed. Only headers matching the filter (if one is given) are kept, and each
+// is added to the project so that it is parsed with its source's command. The return
+// value is 1 if any trace had errors and 0 otherwise.
+static int TraceProject(ProjectDatabase &project, Arguments &args, FileManager &files,
+    const string &filter, std::vector<string> &headers) {
+  llvm::Regex regex(filter);
+  std::set<string> listed;
+  int errors = 0;
+  for (const string &source : project.getAllFiles()) {
+    std::vector<CompileCommand> commands = project.getCompileCommands(source);
+    if (commands.empty() == true) {
+      continue;
+    }
+    std::stack<string> stackfiles;
+    CHSFrontendActionFactory CHSFactory(stackfiles, args);
+    if (RunToolOnFile(project, source, &CHSFactory, &files) != 0) {
+      errs() << "Error during preprocessor-tracing tool run on " << source << "\n";
+      errors = 1;
+    }
+    std::stack<string> sorted_headers = SortHeaderStack(stackfiles);
+    while (sorted_headers.empty() == false) {
+      string headerfile = sorted_headers.top();
+      sorted_headers.pop();
+      if (sorted_headers.empty() == true) {
+        break;  // This is the source itself.
+      }
+      // The names traced are relative to the directory the source is compiled in.
+      SmallString<256> path;
+      if (sys::path::is_relative(headerfile)) {
+        path = commands.front().Directory;
+        sys::path::append(path, headerfile);
+      } else {
+        path = headerfile;
+      }
+      sys::path::remove_dots(path, true);
+      string header = path.str();
+      if (listed.count(header) > 0 || (filter.size() && regex.match(header) == false)) {
+        continue;
+      }
+      listed.insert(header);
+      headers.push_back(header);
+      project.AddHeader(header, source);
+    }
+  }
+  return(errors);
+}
+
+// Keeps the names a translation's duplicate identifier checks found to be new. These
+// are the ones its module declares, even during a -together run where every module
+// shares the same scope.
+static void RecordDeclared(const GuardLog &log, ModuleTranslation &translation) {
+  translation.declared.clear();
+  for (const std::pair<string, bool> &check : log) {
+    if (check.second == true) {
+      translation.declared.push_back(check.first);
+    }
+  }
+}
+
+// Checks a module translated by a worker against the names declared by the modules
+// written before it (see SymbolTable::setChained). If it declares none of them, its
+// names are added to the module's scope, without a location, just as they would
+// have been had it been translated here. Returns true if it does.
+static bool RedeclaresEarlierNames(const ModuleTranslation &translation,
+    SymbolTable &symbols) {
+  symbols.setScope(translation.module_name);
+  for (const string &name : translation.declared) {
+    if (symbols.isDeclared(name) == true) {
+      return true;
+    }
+  }
+  for (const string &name : translation.declared) {
+    symbols.Declare(name, "", PresumedLoc());
+  }
+  return false;
+}
+
+// Runs the translation tool on a single header. The module's body is sent to the
+// buffer in the translation rather than the output file and the boiler plate is
+// left for the main program to write, unless the translation says to write the
+// module straight to the output (see ModuleTranslation::direct). This may be run on a worker thread, in which case
+// the arguments passed in belong to that worker alone. A FileManager is not safe
+// to share between threads, so a worker passes in a null pointer and gets one of
+// its own over the shared file system cache. The extra arguments (if any) are
+// passed on to the tool, see RunToolOnFile. If a translation cache is given, a
+// valid cached body is used instead of running the tool at all, and a successful
+// translation is added to the cache.
+static void TranslateHeader(CompilationDatabase &Compilations,
+    ModuleTranslation &translation, Arguments &args, FileManager *files,
+    IntrusiveRefCntPtr<CachingFileSystem> cache, const std::vector<string> &extra_args,
+    TranslationCache *translation_cache) {
+  if (args.getTimeReport() != nullptr) {
+    args.getTimeReport()->BeginHeader(translation.headerfile);
+  }
+  TimeTrace::Scope header_span(args.getTimeTrace(), "Translate header",
+      translation.headerfile);
+  // Duplicate identifiers are only a problem within a module (and the modules it
+  // USEs, see SymbolTable), unless all the modules are being put together, in which
+  // case there is only the one scope.
+  args.getSymbols().setScope(args.getTogether() ? "" : translation.module_name);
+  // Every duplicate identifier check is logged, since the names found to be new are
+  // the ones this module declares (see ModuleIndex). The cache needs them as well.
+  GuardLog log;
+  args.setGuardLog(&log);
+  string key;
+  if (translation_cache != nullptr) {
+    key = translation_cache->getKey(translation.headerfile, args, Compilations,
+        extra_args);
+    if (translation_cache->Lookup(key, translation, args) == true) {
+      args.setGuardLog(nullptr);
+      RecordDeclared(log, translation);
+      return;  // Nothing more to do.
+    }
+  }
+  std::unique_ptr<FileManager> own_files;
+  if (files == nullptr) {
+    own_files.reset(new FileManager(FileSystemOptions(), cache));
+    files = own_files.get();
+  }
+  raw_string_ostream body(translation.body);
+  args.setOutputRedirect(translation.direct != nullptr ? translation.direct : &body);
+  args.setModuleName(translation.module_name);
+  if (StatsJSON == true) {
+    args.setStats(&translation.stats);
+  }
+  TNAFrontendActionFactory factory("", args, &translation);
+  // Run the translation tool.
+  {
+    TimeReport::Scope parse_time(args.getTimeReport(), TimeReport::PARSE);
+    TimeTrace::Scope parse_span(args.getTimeTrace(), "Clang tool run",
+        translation.headerfile);
+    translation.tool_errors = RunToolOnFile(Compilations, translation.headerfile,
+        &factory, files, extra_args);
+  }
+  body.flush();
+  args.setStats(nullptr);
+  args.setGuardLog(nullptr);
+  args.setOutputRedirect(nullptr);
+  args.setModuleName("");  // For safety, unset the module name passed out of Arguments
+  RecordDeclared(log, translation);
+  // Only a clean translation is worth keeping.
+  if (translation_cache != nullptr && translation.tool_errors == 0 &&
+      translation.started == true) {
+    translation_cache->Store(key, translation, log, args);
+  }
+}
+
+// Finds or builds the precompiled header for the system headers of a recursive run
+// in the given directory and returns its path. The header is named after a hash of
+// everything which could change it: the Clang version, the front end arguments and
+// the names and contents of all the system headers seen by the trace. A header
+// built by an earlier invocation is reused as it is. An empty string is returned,
+// after a warning, if there is nothing to precompile or it could not be done.
+static string PrepareSystemPCH(string directory, SystemIncludes &includes,
+    CompilationDatabase &Compilations, IntrusiveRefCntPtr<CachingFileSystem> cache,
+    Arguments &args) {
+  if (includes.top_level.empty() == true) {
+    return "";  // The project does not include any system headers.
+  }
+  std::error_code error = sys::fs::create_directories(directory);
+  if (error) {
+    if (args.getSilent() == false) {
+      errs() << "Warning: unable to create precompiled header directory " << directory;
+      errs() << ": " << error.message() << ". System headers will be parsed as usual.\n";
+    }
+    return "";
+  }
+
+  MD5 hash;
+  hash.update(getClangFullVersion());
+  hash.update(other);
+  for (const string &include : includes.top_level) {
+    hash.update(include);
+  }
+  // The file contents come out of the cache. The trace has just read them all.
+  for (const string &file : includes.files) {
+    hash.update(file);
+    llvm::ErrorOr<std::unique_ptr<vfs::File>> opened = cache->openFileForRead(file);
+    if (opened) {
+      llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = (*opened)->getBuffer(file);
+      if (buffer) {
+        hash.update((*buffer)->getBuffer());
+      }
+    }
+  }
+  MD5::MD5Result result;
+  hash.final(result);
+  SmallString<32> hex;
+  MD5::stringifyResult(result, hex);
+
+  SmallString<256> pch_path(directory);
+  sys::path::append(pch_path, "h2m_system_" + hex.str().str() + ".pch");
+  if (sys::fs::exists(pch_path) == true) {  // Built by an earlier run.
+    if (args.getSilent() == false) {
+      errs() << "Using precompiled system headers " << pch_path << "\n";
+    }
+    return pch_path.str();
+  }
+
+  // Write a header including every top level system header and precompile it.
+  SmallString<256> header_path(directory);
+  sys::path::append(header_path, "h2m_system_" + hex.str().str() + ".h");
+  {
+    raw_fd_ostream header(header_path, error, sys::fs::F_Text);
+    if (error) {
+      if (args.getSilent() == false) {
+        errs() << "Warning: unable to write " << header_path << ": " << error.message();
+        errs() << ". System headers will be parsed as usual.\n";
+      }
+      return "";
+    }
+    for (const string &include : includes.top_level) {
+      header << "#include " << include << "\n";
+    }
+  }
+  FileManager files(FileSystemOptions(), cache);
+  SystemPCHFactory factory(pch_path.str());
+  if (RunToolOnFile(Compilations, header_path.str(), &factory, &files) != 0 ||
+      sys::fs::exists(pch_path) == false) {
+    if (args.getSilent() == false) {
+      errs() << "Warning: unable to precompile the system headers. ";
+      errs() << "They will be parsed as usual.\n";
+    }
+    return "";
+  }
+  if (args.getSilent() == false) {
+    errs() << "Precompiled system headers to " << pch_path << "\n";
+  }
+  return pch_path.str();
+}
+
+// Writes the statistics of an input's modules, their totals and the peak memory use
+// of the process so far as a JSON object to the given file (-stats-json).
+static bool WriteStatsFile(const string &path, const string &input,
+    const std::vector<ModuleTranslation> &modules) {
+  std::error_code error;
+  raw_fd_ostream out(path, error, sys::fs::F_Text);
+  if (error) {
+    return false;
+  }
+  TranslationStats total;
+  out << "{\n  \"input\": \"" << EscapeJSON(input) << "\",\n  \"modules\": [";
+  for (size_t i = 0; i < modules.size(); i++) {
+    const ModuleTranslation &module = modules[i];
+    total.Add(module.stats);
+    out << (i == 0 ? "\n" : ",\n") << "    {\n";
+    out << "      \"header\": \"" << EscapeJSON(module.headerfile) << "\",\n";
+    out << "      \"module\": \"" << EscapeJSON(module.module_name) << "\",\n";
+    out << "      \"tool_errors\": " << module.tool_errors << ",\n";
+    out << "      \"from_cache\": " << (module.from_cache ? "true" : "false") << ",\n";
+    module.stats.WriteJSON(out, "      ");
+    out << "\n    }";
+  }
+  out << "\n  ],\n  \"total\": {\n";
+  total.WriteJSON(out, "    ");
+  out << "\n  },\n";
+  // The peak resident set size of the whole process, which Linux gives in kilobytes.
+  struct rusage usage;
+  long peak_rss = 0;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    peak_rss = usage.ru_maxrss;
+  }
+  out << "  \"peak_rss_kb\": " << peak_rss << "\n}\n";
+  out.close();
+  bool failed = out.has_error();
+  out.clear_error();
+  return failed == false;
+}
+
+// The front end state shared by every input of a run: the compilation database,
+// the cached view of the file system (with a FileManager over it for the tool runs
+// made on the main thread) and the translation cache, if there is one. During a
+// project run (-p) the compilation database is the project, which is also kept here.
+struct SharedState {
+  CompilationDatabase &Compilations;
+  IntrusiveRefCntPtr<CachingFileSystem> file_cache;
+  FileManager &shared_files;
+  TranslationCache *translation_cache;
+  ProjectDatabase *project;
+  // Where phases are timed during a timed run (-time-report), or a null pointer.
+  TimeReport *time_report;
+  // Where spans are recorded for the trace-event file (-time-trace), or a null pointer.
+  TimeTrace *time_trace;
+  // Where the slowest declarations are kept (-profile-decls), or a null pointer.
+  DeclProfile *decl_profile;
+  // Where the warnings of every input are collected.
+  Diagnostics *diagnostics;
+};
+
+// Translates one input file into the given output file ("-" for stdout) using the
+// front end state shared by every input of the run. This is everything a run of h2m
+// did before batch runs existed, and it is done once for each input of a batch. The
+// result is the error code of the last tool run, or 1 if the output can't be opened.
+static int TranslateInput(const string &input, const string &filename,
+    SharedState &shared) {
+  CompilationDatabase *Compilations = &shared.Compilations;
+  IntrusiveRefCntPtr<CachingFileSystem> file_cache = shared.file_cache;
+  FileManager &shared_files = shared.shared_files;
+  std::error_code error;
+  // The file is opened in text mode
+  llvm::tool_output_file OutputFile(filename, error, llvm::sys::fs::F_Text);
+  if (error) {  // Error opening file
+    errs() << "Error opening output file: " << filename << error.message() << "\n";
+    return(1);  // We can't possibly keep going if the file can't be opened.
+  }
+  if (Optimistic == true) {  // Keep all output inspite of errors
+    OutputFile.keep();  // We have to call this in order for the file to be permanent.
+  }
+  // Create an object to pass around arguments. This object will hold
+  // the name of the current file processed as well as information about
+  // what to include, how to warn, and what problems should not be commented
+  // out (the various IgnoreSomething parameters).
+  Arguments args(Quiet, Silent, OutputFile, NoHeaders, Together, Transpose,
+      Autobind, HideMacros, IgnoreName, IgnoreLine, IgnoreType, IgnoreAnon,
+      IgnoreDuplicate);
+  args.setTimeReport(shared.time_report);
+  args.setTimeTrace(shared.time_trace);
+  args.setDeclProfile(shared.decl_profile);
+  args.setDiagnostics(shared.diagnostics);
+  args.setSpillLimit(SpillLimit);
+  // A module which USEs every module before it can't declare their names again.
+  args.getSymbols().setChained(UseAllModules);
+  TimeTrace::Scope input_span(shared.time_trace, "Translate input", input);
+  if (shared.time_report != nullptr) {  // Nothing from an earlier input is charged on.
+    shared.time_report->EndHeader();
+  }
+
+
+  // During an incremental run, translations from the last run into this output file
+  // are reused from the manifest next to it. Otherwise the shared cache (if any) is used.
+  std::unique_ptr<TranslationCache> manifest_cache;
+  TranslationCache *translation_cache = shared.translation_cache;
+  string manifest;
+  if (Incremental == true) {
+    manifest = filename + ".h2m-manifest";
+    manifest_cache.reset(new TranslationCache(manifest, file_cache, true));
+    translation_cache = manifest_cache.get();
+  }
+  int tool_errors = 0;  // No errors have occurred running the tool yet
+  // The modules whose statistics are written out at the end (-stats-json).
+  std::vector<ModuleTranslation> stats_modules;
+
+
+  // Write some initial text into the file, just boilerplate stuff.
+  OutputFile.os() << "! The following Fortran code was generated by the h2m-AutoFortran ";
+  OutputFile.os() << "Tool.\n! See the h2m README file for credits and help information.\n\n";
+
+  // Parse the whole tree once, following the preprocessor's inclusions and
+  // translating everything seen along the way. The translations are then
+  // split into modules by file and linked by "USE" statements in the same
+  // order a normal recursive run would use.
+  if (Recursive && SingleParse) {
+    ModuleSplitter splitter;
+    args.setSplitter(&splitter);
+    // SP means "single parse."
+    SPFrontendActionFactory SPFactory(splitter, args);
+    // There is only one parse, so its statistics are kept as a single entry.
+    ModuleTranslation parse_stats;
+    parse_stats.headerfile = input;
+    if (StatsJSON == true) {
+      args.setStats(&parse_stats.stats);
+    }
+    if (args.getTimeReport() != nullptr) {
+      args.getTimeReport()->BeginHeader(input);
+    }
+    {
+      TimeReport::Scope parse_time(args.getTimeReport(), TimeReport::PARSE);
+      TimeTrace::Scope parse_span(args.getTimeTrace(), "Clang tool run (single parse)",
+          input);
+      tool_errors = RunToolOnFile(*Compilations, input, &SPFactory, &shared_files);
+    }
+    args.setStats(nullptr);
+    args.setSplitter(nullptr);
+    // Errors can't be pinned to any one file since there was only one parse.
+    // Every module is treated as if it were suspect.
+    shared.diagnostics->Flush();  // The warnings come before the report on the run.
+    if (tool_errors != 0) {
+      if (Silent == false) {
+        errs() << "Translation error occured during the single-parse run";
+        errs() <<  ". Output may be corrupted or missing.\n";
+      }
+      if (splitter.stackfiles.empty() == true) {  // Whatever happend is not recoverable.
+        errs() << "Unrecoverable error. No files recorded to translate.\n";
+        return(tool_errors);
+      }
+    }
+    std::stack<string> sorted_headers = SortHeaderStack(splitter.stackfiles);
+
+    // Write out the modules in order, just as the normal recursive loop below
+    // would have written them.
+    ModuleIndex index(UseAllModules);  // Which of the modules written so far declares what
+    while (sorted_headers.empty() == false) {
+      string headerfile = sorted_headers.top();
+      sorted_headers.pop(); 
+
+      // We have been asked to skip the last file (which is this file).
+      if (sorted_headers.empty() && IgnoreThis == true) {
+        break;  // Leave the module processing while loop.
+      }
+
+      ModuleSplitter::FileText &text = splitter.getFileText(headerfile);
+      string module_name = args.GenerateModuleName(headerfile);
+      // Each file's names were declared in a scope of its own, named for the file.
+      std::vector<string> declared;
+      args.getSymbols().getNames(headerfile, declared);
+      {
+        TimeReport::Scope output_time(args.getTimeReport(), TimeReport::OUTPUT);
+        TimeTrace::Scope output_span(args.getTimeTrace(), "Write module", module_name);
+        uint64_t written = OutputFile.os().tell();
+        string use_modules = index.UseStatements({text.body, text.functions}, declared);
+        OutputFile.os() << TraverseNodeAction::BeginModuleText(module_name, use_modules);
+        OutputFile.os() << text.body;
+        // Wrap all the functions in a single interface as usual.
+        if (!text.functions.empty()) {
+          OutputFile.os() << "INTERFACE\n" << text.functions << "END INTERFACE\n";
+        }
+        OutputFile.os() << TraverseNodeAction::EndModuleText(module_name);
+        parse_stats.stats.bytes_emitted += OutputFile.os().tell() - written;
+      }
+
+      if (tool_errors != 0) {  // The parse had errors, so the module may be corrupt.
+        index.AddModule(module_name, declared, LinkAll == true);
+        OutputFile.os()  << "! Warning: Translation Error Occurred on this module\n";
+      } else {  // Successful run, no errors
+        index.AddModule(module_name, declared, true);
+        if (Silent == false) {  // Don't clutter the screen if the run is silent
+          errs() << "Successfully processed " << headerfile << "\n";
+          errs() << "\n\n\n\n";  // Put four lines between files to help keep track of errors
+        }
+      }
+      args.setModuleName("");  // For safety, unset the module name passed out of Arguments
+      OutputFile.os() << "\n\n";  // Put two lines inbetween modules, even on a trans. failure
+    }
+    if (args.getTimeReport() != nullptr) {
+      args.getTimeReport()->EndHeader();
+    }
+    if (StatsJSON == true) {
+      stats_modules.push_back(parse_stats);
+    }
+
+  // Follow the preprocessor's inclusions to generate a recursive 
+  // order of headers to be translated and linked by "USE" statements
+  // A project run does the same with the headers of every source in the project.
+  } else if (Recursive || shared.project != nullptr) {
+    std::stack<string> stackfiles;
+    std::vector<string> headers;  // The headers in the order they are to be translated
+    // The system headers are only recorded if they are to be precompiled.
+    SystemIncludes system_includes;
+    bool precompile = SystemPCH.size() && shared.project == nullptr;
+    int initerrs = 0;
+    {  // Only the trace itself is timed as the trace.
+      TimeReport::Scope trace_time(args.getTimeReport(), TimeReport::TRACE);
+      TimeTrace::Scope trace_span(args.getTimeTrace(), "Trace includes", input);
+      if (shared.project != nullptr) {
+        initerrs = TraceProject(*shared.project, args, shared_files, HeaderFilter, headers);
+      } else {
+        // CHS means "CreateHeaderStack." 
+        CHSFrontendActionFactory CHSFactory(stackfiles, args,
+            precompile ? &system_includes : nullptr);
+        // Run the first action to follow inclusions
+        initerrs = RunToolOnFile(*Compilations, input, &CHSFactory, &shared_files);
+        // Sort the files seen into the order they should be translated.
+        std::stack<string> sorted_headers = SortHeaderStack(stackfiles);
+        // Dig through the created stack of header files we have seen, as prepared by
+        // the first clang tool and sorted/reversed by the loop above into the proper
+        // order for recursive inclusion.
+        while (sorted_headers.empty() == false) {
+          string headerfile = sorted_headers.top();
+          sorted_headers.pop(); 
+
+          // We have been asked to skip the last file (which is this file)
+          // so skip. Use a break statement to avoid awkward code.
+          if (sorted_headers.empty() && IgnoreThis == true) {
+            break;  // Leave the module processing while loop.
+          }
+          headers.push_back(headerfile);
+        }
+      }
+    }
+    // If the attempt to find the needed order to translate the headers fails,
+    // this effort is probably doomed.
+    if (initerrs != 0) {
+      errs() << "Error during preprocessor-tracing tool run, errno ." << initerrs << "\n";
+      if (Optimistic == false) {  // Exit unless told to keep going
+        errs() << "A non-recursive run may succeed.\n";
+        errs() << "Alternately, enable optimistic mode (-keep-going or -k) to continue despite errors.\n";
+        return(initerrs);
+      } else if (headers.empty() == true) {  // Whatever happend is not recoverable.
+        errs() << "Unrecoverable initialization error. No files recorded to translate.\n";
+        return(initerrs);
+      } else {  // Because we are optimistic and the error isn't hopeless, continue.
+        errs() << "Optimistic run continuing.\n";
+      }
+    }
+
+    // The module names are chosen here, in order, because GenerateModuleName
+    // must see the files in the same order every time.
+    std::vector<ModuleTranslation> translations;
+    for (const string &headerfile : headers) {
+      ModuleTranslation translation;
+      translation.headerfile = headerfile;
+      translation.module_name = args.GenerateModuleName(headerfile);
+      translations.push_back(translation);
+    }
+    args.setModuleName("");
+
+    // Precompile the system headers (or find them already precompiled) so that
+    // the project headers need not parse them over and over again. Validation
+    // is turned off when loading since the name of the precompiled header
+    // already depends on the contents of the files that went into it.
+    std::vector<string> pch_args;
+    if (precompile == true) {
+      TimeTrace::Scope pch_span(args.getTimeTrace(), "Precompile system headers");
+      string pch = PrepareSystemPCH(SystemPCH, system_includes, *Compilations,
+          file_cache, args);
+      if (pch.empty() == false) {
+        pch_args = {"-include-pch", pch, "-Xclang", "-fno-validate-pch"};
+      }
+    }
+    // The system headers themselves are translated without it. Everything they
+    // contain is already in the precompiled header, so their include guards
+    // would leave nothing to translate.
+    std::vector<string> no_args;
+    std::vector<const std::vector<string> *> header_args;
+    for (ModuleTranslation &translation : translations) {
+      if (system_includes.files.count(translation.headerfile) > 0) {
+        header_args.push_back(&no_args);
+      } else {
+        header_args.push_back(&pch_args);
+      }
+    }
+
+    // Each header is translated into a buffer on its own. The translations do not
+    // depend on each other, only the USE statements written around them do, so
+    // with more than one job they are handed out to a pool of workers. Each
+    // worker gets its own copy of the arguments. Duplicate identifiers are only
+    // looked for within a module, except with -use-all-modules, which is put right
+    // as the modules are written (see below).
+    unsigned jobs = Jobs;
+    if (jobs == 0) {  // Use everything available
+      jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<std::shared_future<void>> finished;
+    std::unique_ptr<ThreadPool> pool;
+    std::deque<Arguments> worker_args;  // A deque never moves what it holds
+    if (jobs > 1 && translations.size() > 1) {
+      pool.reset(new ThreadPool(jobs));
+      for (size_t i = 0; i < translations.size(); i++) {
+        ModuleTranslation &translation = translations[i];
+        const std::vector<string> &extra_args = *header_args[i];
+        worker_args.push_back(args);
+        Arguments &task_args = worker_args.back();
+        CompilationDatabase &database = *Compilations;
+        TranslationCache *cache = translation_cache;
+        finished.push_back(pool->async([&translation, &task_args, &database,
+            file_cache, &extra_args, cache]() {
+          TranslateHeader(database, translation, task_args, nullptr, file_cache,
+              extra_args, cache);
+        }));
+      }
+    }
+
+    // Write out the modules in order as they become available.
+    ModuleIndex index(UseAllModules);  // Which of the modules written so far declares what
+    for (size_t i = 0; i < translations.size(); i++) {
+      ModuleTranslation &translation = translations[i];
+      uint64_t written = OutputFile.os().tell();
+      if (pool) {
+        finished[i].wait();
+        // A worker could not see the names declared by the modules before this one.
+        // If it declared one of them again, it is translated again here, where they
+        // are known, so that the duplicates are commented out as in a serial run.
+        if (UseAllModules == true && translation.started == true &&
+            RedeclaresEarlierNames(translation, args.getSymbols()) == true) {
+          ModuleTranslation again;
+          again.headerfile = translation.headerfile;
+          again.module_name = translation.module_name;
+          translation = again;
+          TranslateHeader(*Compilations, translation, args, &shared_files, file_cache,
+              *header_args[i], translation_cache);
+        }
+      } else {  // Only one job. Translate right here with the shared arguments.
+        // With -use-all-modules the USE statements do not depend on the body, so
+        // unless it is to be cached it goes straight to the output file.
+        if (UseAllModules == true && translation_cache == nullptr) {
+          translation.direct = &OutputFile.os();
+          translation.use_modules = index.UseStatements({}, translation.declared);
+        }
+        TranslateHeader(*Compilations, translation, args, &shared_files, file_cache,
+            *header_args[i], translation_cache);
+      }
+      // The module USEs only what it refers to from the modules written before it.
+      if (translation.started == true && translation.direct == nullptr) {
+        TimeReport::Scope output_time(args.getTimeReport(), TimeReport::OUTPUT);
+        TimeTrace::Scope output_span(args.getTimeTrace(), "Write module",
+            translation.module_name);
+        OutputFile.os() << TraverseNodeAction::BeginModuleText(translation.module_name,
+            index.UseStatements({translation.body}, translation.declared));
+        OutputFile.os() << translation.body;
+        OutputFile.os() << TraverseNodeAction::EndModuleText(translation.module_name);
+      }
+      translation.stats.bytes_emitted = OutputFile.os().tell() - written;
+      tool_errors = translation.tool_errors;
+      shared.diagnostics->Flush();  // The module's warnings come before the report on it.
+
+      if (tool_errors != 0) {  // Tool error occurred
+        if (Silent == false) {  // Do not report the error if the run is silent.
+          errs() << "Translation error occured on " << translation.headerfile;
+          errs() <<  ". Output may be corrupted or missing.\n";
+          errs() << "\n\n\n\n";  // Put four lines between files to help keep track of errors
+        }
+        // Comment out the use statements for this module becuase it may be corrupt,
+        // unless the option to link-all modules was specified, in which case connect
+        // it up anyway. A module never begun declares nothing anyone could use.
+        if (translation.started == true) {
+          index.AddModule(translation.module_name, translation.declared, LinkAll == true);
+        }
+        OutputFile.os()  << "! Warning: Translation Error Occurred on this module\n";
+      } else {  // Successful run, no errors
+        // Record what it declares for the modules which come after it
+        index.AddModule(translation.module_name, translation.declared, true);
+        if (Silent == false) {  // Don't clutter the screen if the run is silent
+          errs() << "Successfully processed " << translation.headerfile << "\n";
+          errs() << "\n\n\n\n";  // Put four lines between files to help keep track of errors
+        }
+      }
+      translation.body.clear();  // This has been written. Don't hold on to it.
+      if (StatsJSON == true) {
+        stats_modules.push_back(translation);
+      }
+
+      OutputFile.os() << "\n\n";  // Put two lines inbetween modules, even on a trans. failure
+      if (args.getTimeReport() != nullptr) {  // Whatever comes next isn't this header's.
+        args.getTimeReport()->EndHeader();
+      }
+   }  // End looking through the stack and processing all headers (including the original).
+
+    // Record what every module was translated from for the next incremental run.
+    if (Incremental == true) {
+      manifest_cache->SaveManifest(args);
+    }
+
+  } else {  // No recursion, just run the tool on the first input file. No module list string is needed.
+    ModuleTranslation translation;
+    translation.headerfile = input;
+    translation.module_name = args.GenerateModuleName(input);
+    // There is nothing to USE, so the module is only held back to be cached.
+    if (translation_cache == nullptr) {
+      translation.direct = &OutputFile.os();
+    }
+    uint64_t written = OutputFile.os().tell();
+    TranslateHeader(*Compilations, translation, args, &shared_files, file_cache,
+        std::vector<string>(), translation_cache);
+    if (translation.started == true && translation.direct == nullptr) {
+      TimeReport::Scope output_time(args.getTimeReport(), TimeReport::OUTPUT);
+      TimeTrace::Scope output_span(args.getTimeTrace(), "Write module",
+          translation.module_name);
+      OutputFile.os() << TraverseNodeAction::BeginModuleText(translation.module_name, "");
+      OutputFile.os() << translation.body;
+      OutputFile.os() << TraverseNodeAction::EndModuleText(translation.module_name);
+    }
+    translation.stats.bytes_emitted = OutputFile.os().tell() - written;
+    if (StatsJSON == true) {
+      translation.body.clear();
+      stats_modules.push_back(translation);
+    }
+    if (args.getTimeReport() != nullptr) {
+      args.getTimeReport()->EndHeader();
+    }
+    tool_errors = translation.tool_errors;
+  }  // End processing of the translation
+
+
+  // Report how many modules came out of the manifest.
+  if (manifest_cache && Quiet == false && Silent == false) {
+    errs() << "Incremental run: " << manifest_cache->getHits() << " of ";
+    errs() << manifest_cache->getHits() + manifest_cache->getMisses();
+    errs() << " modules reused from " << manifest << "\n";
+  }
+
+  // Write the statistics next to the output.
+  if (StatsJSON == true) {
+    string stats_file = filename + ".stats.json";
+    if (WriteStatsFile(stats_file, input, stats_modules) == false) {
+      errs() << "Error writing statistics file: " << stats_file << "\n";
+    } else if (Silent == false) {
+      errs() << "Statistics written to " << stats_file << "\n";
+    }
+  }
+
+  // Flush what is left of the output now so that the time it takes shows in the trace.
+  {
+    TimeTrace::Scope flush_span(shared.time_trace, "Flush output", filename);
+    OutputFile.os().flush();
+  }
+
+  // Note that the output has already been kept if this is an optimistic run. It doesn't hurt to keep twice.
+  if (!tool_errors) {  // If the last run of the tool was not successful, the output may be garbage.
+    OutputFile.keep();
+  }
+
+  // A compiler post-process has been specified and there is an actual output file,
+  // prepare and run the compiler.
+  if (Compiler.size() && filename.compare("-") != 0) {
+    OutputFile.os().flush();  // Attempt to flush the stream to avoid a partial read by the compiler
+    if (system(NULL) == true) {  // A command interpreter is available
+      string command = Compiler + " " + filename;
+      int success = system(command.c_str());
+	if (Silent == false) {  // Notify if the run is noisy
+	  if (success == 0) {  // Successful compilation.
+	    errs() << "Successful compilation of " << filename << " with " << Compiler << "\n";
+	  } else {  // Inform of the error and give the error number
+	    errs() << "Unsuccessful compilation of " << filename << " with ";
+	    errs() << Compiler << ". Error: " << success << "\n";
+	  } 
+      }
+    } else {  // Cannot run using system (fork might succeed but is very error prone).
+      errs() << "Error: No command interpreter available to run system process " << Compiler << "\n";
+    }
+  // We were asked to run the compiler, but there is no output file, report an error.
+  } else if (Compiler.size() && filename.compare("-") == 0) {
+    errs() << "Error: unable to attempt compilation on standard output.\n";
+  }
+  return(tool_errors);
+}
 
 // Begin the execution of the h2m tool.
 int main(int argc, const char **argv) {
@@ -391,6 +1483,24 @@ int main(int argc, const char **argv) {
       errs() << "Error: incompatible options, skip given file and no recursion (-i without -r).\n";
       errs() << "Either specify a recursive translation or remove the option to skip the first file.\n";
       return(1);
+    } else if (SingleParse == true && Recursive == false) {  // Nothing to split without recursion
+      errs() << "Error: incompatible options, single-parse run without recursion (-single-parse without -r).\n";
+      errs() << "Either specify a recursive translation or remove the single-parse option.\n";
+      return(1);
+    } else if (Incremental == true &&
+        ((Recursive == false && BuildPath.size() == 0) || SingleParse == true)) {
+      errs() << "Error: incompatible options, incremental run without a normal recursive run\n";
+      errs() << "(-incremental without -r or -p, or with -single-parse).\n";
+      errs() << "Either specify a recursive translation or remove the incremental option.\n";
+      return(1);
+    } else if (Incremental == true && OutputFile.size() == 0 && OutDir.size() == 0) {
+      // The manifest is kept next to the output file, and there is none.
+      errs() << "Error: an incremental run requires an output file (-incremental without -out).\n";
+      return(1);
+    } else if (SingleParse == true && Together == true) {
+      // The single-parse run already sorts every declaration into the module of its own file.
+      errs() << "Warning: request for all local includes to be sent to a single file is ignored\n";
+      errs() << "during a single-parse run (-t and -single-parse).\n";
     // If all the main file's AST (including headers courtesty of the preprocessor) is sent to one
     // module and a recursive option is also specified, things defined in the headers will be
     // defined multiple times over several recursively translated modules.
@@ -398,167 +1508,226 @@ int main(int argc, const char **argv) {
       errs() << "Warning: request for all local includes to be sent to a single file accompanied\n";
       errs() << "by recursive translation (-t and -r) may result in multiple declarations.\n";
     }
-    // Determine file to open and initialize it. Write to stdout if no file is given.
-    string filename;
-    std::error_code error;
-    if (OutputFile.size()) {
-      filename = OutputFile;
-    } else {
-      filename = "-";  // This will send output to stdout.
-    }
-    // The file is opened in text mode
-    llvm::tool_output_file OutputFile(filename, error, llvm::sys::fs::F_Text);
-    if (error) {  // Error opening file
-      errs() << "Error opening output file: " << filename << error.message() << "\n";
-      return(1);  // We can't possibly keep going if the file can't be opened.
-    }
-    if (Optimistic == true) {  // Keep all output inspite of errors
-      OutputFile.keep();  // We have to call this in order for the file to be permanent.
-    }
-    // Create an object to pass around arguments. This object will hold
-    // the name of the current file processed as well as information about
-    // what to include, how to warn, and what problems should not be commented
-    // out (the various IgnoreSomething parameters).
-    Arguments args(Quiet, Silent, OutputFile, NoHeaders, Together, Transpose,
-        Autobind, HideMacros, IgnoreName, IgnoreLine, IgnoreType, IgnoreAnon,
-        IgnoreDuplicate);
-
-
-    // Create a new clang tool to be used to run the frontend actions
-    ClangTool Tool(*Compilations, SourcePaths);
-    int tool_errors = 0;  // No errors have occurred running the tool yet
-
-
-    // Write some initial text into the file, just boilerplate stuff.
-    OutputFile.os() << "! The following Fortran code was generated by the h2m-AutoFortran ";
-    OutputFile.os() << "Tool.\n! See the h2m README file for credits and help information.\n\n";
-
-    // Follow the preprocessor's inclusions to generate a recursive 
-    // order of headers to be translated and linked by "USE" statements
-    if (Recursive) {
-      std::stack<string> stackfiles;
-      // CHS means "CreateHeaderStack." 
-      CHSFrontendActionFactory CHSFactory(stackfiles, args);
-      int initerrs = Tool.run(&CHSFactory);  // Run the first action to follow inclusions
-      // If the attempt to find the needed order to translate the headers fails,
-      // this effort is probably doomed.
-      if (initerrs != 0) {
-        errs() << "Error during preprocessor-tracing tool run, errno ." << initerrs << "\n";
-        if (Optimistic == false) {  // Exit unless told to keep going
-          errs() << "A non-recursive run may succeed.\n";
-          errs() << "Alternately, enable optimistic mode (-keep-going or -k) to continue despite errors.\n";
-          return(initerrs);
-        } else if (stackfiles.empty() == true) {  // Whatever happend is not recoverable.
-          errs() << "Unrecoverable initialization error. No files recorded to translate.\n";
-          return(initerrs);
-        } else {  // Because we are optimistic and the error isn't hopeless, continue.
-          errs() << "Optimistic run continuing.\n";
-        }
+    if (OutDir.size() && OutputFile.size()) {
+      errs() << "Error: incompatible options, output file and output directory (-out and -out-dir).\n";
+      return(1);
+    } else if (BuildPath.size() && (SourcePaths.size() || BatchFile.size() || OutDir.size())) {
+      // The project's compilation database says what there is to translate.
+      errs() << "Error: incompatible options, a project run (-p) takes no input files\n";
+      errs() << "and writes a single output file (-batch, -out-dir or an input with -p).\n";
+      return(1);
+    } else if (BuildPath.size() && SingleParse == true) {
+      errs() << "Error: incompatible options, project run and single-parse run (-p and -single-parse).\n";
+      return(1);
+    } else if (HeaderFilter.size() && BuildPath.size() == 0) {
+      errs() << "Error: a header filter can only be used during a project run (-header-filter without -p).\n";
+      return(1);
+    } else if (StatsJSON == true && OutputFile.size() == 0 && OutDir.size() == 0) {
+      // The statistics are written next to the output file, and there is none.
+      errs() << "Error: statistics require an output file (-stats-json without -out).\n";
+      return(1);
+    } else if (DiagnosticsFormat != "json" && DiagnosticsFormat != "sarif") {
+      errs() << "Error: unknown diagnostics format " << DiagnosticsFormat;
+      errs() << " (-diagnostics-format takes json or sarif).\n";
+      return(1);
+    }
+    if (TimeReportOpt == true && Jobs != 1) {
+      // LLVM's timers can't be shared between threads.
+      if (Silent == false) {
+        errs() << "Warning: a timed run translates one header at a time (-time-report and -jobs).\n";
       }
+      Jobs = 1;
+    }
+    string regex_error;
+    if (HeaderFilter.size() && llvm::Regex(HeaderFilter).isValid(regex_error) == false) {
+      errs() << "Error: invalid header filter " << HeaderFilter << ": " << regex_error << "\n";
+      return(1);
+    }
+    if (BuildPath.size() && SystemPCH.size() && Silent == false) {
+      errs() << "Warning: system headers are not precompiled during a project run ";
+      errs() << "(-system-pch and -p).\n";
+    }
 
-      // The algorithm for sorting the order is as follows:
-      // 1. Every time the preprocessor changes to a new file, add that file to
-      //    the top of a stack.
-      // 2. Empty that stack. Every time a file is encountered for the first
-      //    time, add it to the top of a new stack
-      // 3. Use the new stack to give the translation order.
-
-      // This set keeps track of which files have been seen so far.
-      std::set<string> setfiles;
-      std::stack<string> sorted_headers;  // Will hold the headers as we sort them.
-      while (stackfiles.empty() == false) {
-        string headerfile = stackfiles.top();
-        stackfiles.pop();
- 
-        // If this is our first encounter with this file, meaning the "last" time
-        // the file was encountered during our traversal of the inclusion structure...
-        if (setfiles.find(headerfile) == setfiles.end()) {
-          sorted_headers.push(headerfile);  // Add it to the stack to reverse the order.
-          setfiles.insert(headerfile);  // We'll ignore this file if we see it again.
-        }
-      }  // We thus reverse the order so that the first file will be last.
-      
-
-      // Dig through the created stack of header files we have seen, as prepared by
-      // the first clang tool and sorted/reversed by the loop above into the proper
-      // order for recursive inclusion. 
-      string modules_list;  // Accumulates module USE statements in string form
-      while (sorted_headers.empty() == false) {
-        string headerfile = sorted_headers.top();
-        sorted_headers.pop(); 
-
-        // We have been asked to skip the last file (which is this file)
-        // so skip. Use a break statement to avoid awkward code.
-        if (sorted_headers.empty() && IgnoreThis == true) {
-          break;  // Leave the module processing while loop.
+    // A project run takes its commands from the project's compilation database
+    // (usually compile_commands.json) rather than from the command line.
+    std::unique_ptr<ProjectDatabase> project;
+    if (BuildPath.size()) {
+      string load_error;
+      std::unique_ptr<CompilationDatabase> database =
+          CompilationDatabase::loadFromDirectory(BuildPath, load_error);
+      if (!database) {
+        errs() << "Error loading compilation database from " << BuildPath << ": ";
+        errs() << load_error << "\n";
+        return(1);
+      }
+      project.reset(new ProjectDatabase(std::move(database)));
+    }
+
+    // Gather the inputs: the one on the command line (if any) followed by those
+    // listed in the batch file (if any), one per line. Blank lines and lines
+    // beginning with # are skipped.
+    std::vector<string> inputs;
+    if (SourcePaths.size()) {
+      inputs.push_back(SourcePaths);
+    } else if (BuildPath.size()) {  // The whole project is the one input.
+      inputs.push_back(BuildPath);
+    }
+    if (BatchFile.size()) {
+      llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> batch =
+          llvm::MemoryBuffer::getFile(BatchFile);
+      if (!batch) {
+        errs() << "Error opening batch file: " << BatchFile << " ";
+        errs() << batch.getError().message() << "\n";
+        return(1);
+      }
+      SmallVector<StringRef, 64> lines;
+      (*batch)->getBuffer().split(lines, '\n', -1, false);
+      for (StringRef line : lines) {
+        line = line.trim();
+        if (line.empty() == false && line.startswith("#") == false) {
+          inputs.push_back(line.str());
         }
+      }
+    }
+    if (inputs.empty() == true) {
+      errs() << "No header to process was given on the command line or in the batch file.\n";
+      errs() << "Run 'h2m -help' for usage details.\n";
+      return(1);
+    } else if (inputs.size() > 1 && OutDir.size() == 0) {
+      // Every input needs an output file of its own.
+      errs() << "Error: translating more than one input requires an output directory (-out-dir).\n";
+      return(1);
+    }
 
-        // Create a tool to run on each file in turn
-        ClangTool stacktool(*Compilations, headerfile);  
-        TNAFrontendActionFactory factory(modules_list, args);
-        // modules_list is the growing string of previously translated modules this
-        // module may depend on
-        tool_errors = stacktool.run(&factory);  // Run the translation tool.
-
-        if (tool_errors != 0) {  // Tool error occurred
-          if (Silent == false) {  // Do not report the error if the run is silent.
-            errs() << "Translation error occured on " << headerfile;
-            errs() <<  ". Output may be corrupted or missing.\n";
-            errs() << "\n\n\n\n";  // Put four lines between files to help keep track of errors
-          }
-          // Comment out the use statement becuase the module may be corrupt, unless
-          // the option to link-all modules was specified, in which case connect it up
-          // anyway.
-          if (LinkAll == true) {
-            modules_list += "USE " + args.getModuleName() + "\n";
-          } else {
-            modules_list += "! USE " + args.getModuleName() + "\n";
+    // Decide where each input's translation is written. With an output directory,
+    // foo.h becomes foo.f90 there. Inputs with the same name get a number added,
+    // just as repeated module names do. Otherwise there is only one input, and it
+    // goes to the output file or to stdout.
+    std::vector<string> filenames;
+    if (OutDir.size()) {
+      std::error_code error = sys::fs::create_directories(OutDir);
+      if (error) {
+        errs() << "Error creating output directory: " << OutDir << " " << error.message() << "\n";
+        return(1);
+      }
+      std::map<string, int> repeats;
+      for (const string &input : inputs) {
+        string stem = sys::path::stem(input);
+        if (repeats.count(stem) > 0) {
+          string oldstem = stem;
+          stem = stem + "_" + std::to_string(repeats[oldstem]++);
+          if (Silent == false) {
+            errs() << "Warning: repeated output name " << oldstem << ".f90 found, source is ";
+            errs() << input << ". Name changed to " << stem << ".f90\n";
           }
-          OutputFile.os()  << "! Warning: Translation Error Occurred on this module\n";
-        } else {  // Successful run, no errors
-          // Add USE statement to be included in future modules
-          modules_list += "USE " + args.getModuleName() + "\n";
-          if (Silent == false) {  // Don't clutter the screen if the run is silent
-            errs() << "Successfully processed " << headerfile << "\n";
-            errs() << "\n\n\n\n";  // Put four lines between files to help keep track of errors
+        } else {
+          repeats[stem] = 2;
+        }
+        SmallString<256> path(OutDir);
+        sys::path::append(path, stem + ".f90");
+        filenames.push_back(path.str());
+      }
+    } else if (OutputFile.size()) {
+      filenames.push_back(OutputFile);
+    } else {
+      filenames.push_back("-");  // This will send output to stdout.
+    }
+
+    // Everything here is set up once and shared by every input. The tool runs all
+    // share one view of the file system so that files seen by one run (the system
+    // headers especially) do not have to be looked up or read again. Translations
+    // from earlier runs are reused from the cache directory if one was given.
+    IntrusiveRefCntPtr<CachingFileSystem> file_cache(
+        new CachingFileSystem(vfs::getRealFileSystem()));
+    FileManager shared_files(FileSystemOptions(), file_cache);
+    std::unique_ptr<TranslationCache> translation_cache;
+    if (CacheDir.size() && Incremental == true) {
+      if (Silent == false) {
+        errs() << "Warning: the translation cache directory is ignored during an ";
+        errs() << "incremental run (-cache-dir and -incremental).\n";
+      }
+    } else if (CacheDir.size()) {
+      translation_cache.reset(new TranslationCache(CacheDir, file_cache));
+    }
+    std::unique_ptr<TimeReport> time_report;
+    if (TimeReportOpt == true) {
+      time_report.reset(new TimeReport);
+    }
+    std::unique_ptr<TimeTrace> time_trace;
+    if (TimeTraceFile.size()) {
+      time_trace.reset(new TimeTrace);
+    }
+    std::unique_ptr<DeclProfile> decl_profile;
+    if (ProfileDecls > 0) {
+      decl_profile.reset(new DeclProfile(ProfileDecls));
+    }
+    // The warnings are always collected, if only to buffer them and spot repeats.
+    // The records themselves are only kept if they are to be written out.
+    Diagnostics diagnostics(DiagnosticsFile.size() > 0);
+    SharedState shared = {project ? *project : *Compilations, file_cache, shared_files,
+        translation_cache.get(), project.get(), time_report.get(), time_trace.get(),
+        decl_profile.get(), &diagnostics};
+
+    // Translate each input in turn. A failure on one input does not stop the rest.
+    int tool_errors = 0;
+    {
+      TimeTrace::Scope run_span(time_trace.get(), "h2m run");
+      for (size_t i = 0; i < inputs.size(); i++) {
+        int input_errors = TranslateInput(inputs[i], filenames[i], shared);
+        diagnostics.Flush();
+        if (input_errors != 0) {
+          tool_errors = input_errors;
+          if (inputs.size() > 1 && Silent == false) {
+            errs() << "Errors occurred translating " << inputs[i] << " into " << filenames[i] << "\n";
           }
         }
-        args.setModuleName("");  // For safety, unset the module name passed out of Arguments
+      }
+    }
 
-        args.getOutput().os() << "\n\n";  // Put two lines inbetween modules, even on a trans. failure
-     }  // End looking through the stack and processing all headers (including the original).
+    // Repeats were only counted, so say how many there were.
+    if (diagnostics.getRepeats() > 0 && Quiet == false && Silent == false) {
+      errs() << diagnostics.getRepeats() << " repeated warnings were not printed again.\n";
+    }
+    if (DiagnosticsFile.size()) {
+      Diagnostics::Format format = DiagnosticsFormat == "sarif" ? Diagnostics::SARIF :
+          Diagnostics::JSON;
+      if (diagnostics.WriteFile(DiagnosticsFile, format) == false) {
+        errs() << "Error writing diagnostics file: " << DiagnosticsFile << "\n";
+      } else if (Silent == false) {
+        errs() << "Diagnostics written to " << DiagnosticsFile << "\n";
+      }
+    }
 
-    } else {  // No recursion, just run the tool on the first input file. No module list string is needed.
-      TNAFrontendActionFactory factory("", args);
-      tool_errors = Tool.run(&factory);
-    }  // End processing of the translation
+    // The trace covers everything up to here. Failing to write it isn't fatal.
+    if (time_trace && time_trace->Write(TimeTraceFile) == false) {
+      errs() << "Error writing time trace file: " << TimeTraceFile << "\n";
+    } else if (time_trace && Silent == false) {
+      errs() << "Time trace written to " << TimeTraceFile << "\n";
+    }
 
-    // Note that the output has already been kept if this is an optimistic run. It doesn't hurt to keep twice.
-    if (!tool_errors) {  // If the last run of the tool was not successful, the output may be garbage.
-      OutputFile.keep();
+    // The timing report and the slowest declarations are printed whether or not the run is
+    // quiet, since they were asked for.
+    if (time_report) {
+      time_report->Print(errs());
+    }
+    if (decl_profile) {
+      decl_profile->Print(errs());
     }
 
-    // A compiler post-process has been specified and there is an actual output file,
-    // prepare and run the compiler.
-    if (Compiler.size() && filename.compare("-") != 0) {
-      OutputFile.os().flush();  // Attempt to flush the stream to avoid a partial read by the compiler
-      if (system(NULL) == true) {  // A command interpreter is available
-        string command = Compiler + " " + filename;
-        int success = system(command.c_str());
-	if (Silent == false) {  // Notify if the run is noisy
-	  if (success == 0) {  // Successful compilation.
-	    errs() << "Successful compilation of " << filename << " with " << Compiler << "\n";
-	  } else {  // Inform of the error and give the error number
-	    errs() << "Unsuccessful compilation of " << filename << " with ";
-	    errs() << Compiler << ". Error: " << success << "\n";
-	  } 
-        }
-      } else {  // Cannot run using system (fork might succeed but is very error prone).
-        errs() << "Error: No command interpreter available to run system process " << Compiler << "\n";
-      }
-    // We were asked to run the compiler, but there is no output file, report an error.
-    } else if (Compiler.size() && filename.compare("-") == 0) {
-      errs() << "Error: unable to attempt compilation on standard output.\n";
+    // Report how many modules came out of the translation cache.
+    if (translation_cache && Quiet == false && Silent == false) {
+      errs() << "Translation cache: " << translation_cache->getHits() << " of ";
+      errs() << translation_cache->getHits() + translation_cache->getMisses();
+      errs() << " modules reused from " << CacheDir << "\n";
+    }
+
+    // Report how much going to the disk the shared view of the file system saved.
+    if ((Recursive == true || project || inputs.size() > 1) && Quiet == false && Silent == false) {
+      errs() << "File cache: " << file_cache->getSavedStats() << " of ";
+      errs() << file_cache->getSavedStats() + file_cache->getRealStats();
+      errs() << " file lookups and " << file_cache->getSavedReads() << " of ";
+      errs() << file_cache->getSavedReads() + file_cache->getRealReads();
+      errs() << " file reads were answered from memory.\n";
     }
     return(tool_errors);
   }
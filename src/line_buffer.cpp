@@ -0,0 +1,47 @@
+// This file contains the LineBuffer class for the h2m translator.
+// It records where the lines of translated text begin as the text is
+// built so that the lines can be gone through without splitting it.
+
+#include "h2m.h"
+
+// Only the text appended is looked at.
+void LineBuffer::append(StringRef more) {
+  size_t offset = text.size();
+  text.append(more.data(), more.size());
+  for (size_t i = text.find('\n', offset); i != string::npos; i = text.find('\n', i + 1)) {
+    line_starts.push_back(i + 1);
+  }
+}
+
+// This replaces the usual string stream loop which added "! " to every line.
+void LineBuffer::appendCommentedOut(StringRef more) {
+  while (more.empty() == false) {
+    std::pair<StringRef, StringRef> split = more.split('\n');
+    append("! ");
+    append(split.first);
+    append("\n");
+    more = split.second;
+  }
+}
+
+void LineBuffer::clear() {
+  text.clear();
+  line_starts.assign(1, 0);
+}
+
+// A newline at the very end does not begin another line.
+size_t LineBuffer::getLineCount() const {
+  if (text.empty() == true || text.back() == '\n') {
+    return line_starts.size() - 1;
+  }
+  return line_starts.size();
+}
+
+StringRef LineBuffer::getLine(size_t line) const {
+  if (line >= line_starts.size()) {
+    return StringRef();
+  }
+  size_t end = line + 1 < line_starts.size() ? line_starts[line + 1] - 1 : text.size();
+  return StringRef(text).slice(line_starts[line], end);
+}
+
@@ -21,7 +21,8 @@ MacroFormatter::MacroFormatter(const Token MacroNameTok, const MacroDirective *m
   // before it is used.
   if (mi->getDefinitionLoc().isValid()) {
     sloc = SM.getPresumedLoc(mi->getDefinitionLoc());
-    isInSystemHeader = SM.isInSystemHeader(mi->getDefinitionLoc());
+    isInSystemHeader = CToFTypeFormatter::isExcludedSystemHeader(mi->getDefinitionLoc(),
+        SM, args);
   } else {
     isInSystemHeader = false;  // If it isn't anywhere, it isn't in a system header
   }
@@ -69,12 +70,15 @@ bool MacroFormatter::isFunctionLike() {
 // function like. The central error handling function will deal with commenting it out
 // if need be.
 string MacroFormatter::getFortranMacroASString() {
-  string fortranMacro;
+  // The buffer keeps track of its lines (and their lengths) as it is built.
+  LineBuffer fortranMacro;
 
   // If we are not in the main file, don't include this. Just
   // return an empty string.  If the Together argument is specified, include it anyway.
+  // During a single-parse run, every file's macros are wanted (they are sorted into
+  // modules by file later on).
   if (ci.getSourceManager().isInMainFile(md->getMacroInfo()->getDefinitionLoc()) == false
-      && args.getTogether() == false) {
+      && args.getTogether() == false && args.getSplitter() == nullptr) {
     return "";
   } 
   if (!isInSystemHeader) {  // Keeps macros from system headers from bleeding into the file
@@ -193,6 +197,7 @@ string MacroFormatter::getFortranMacroASString() {
         fortranMacro += "SUBROUTINE "+ actual_macroName + "() BIND(C)\n";
       } else {
         fortranMacro += "SUBROUTINE "+ actual_macroName + "(";
+        string arguments;  // The list of arguments, separated by commas
         for (auto it = md->getMacroInfo()->arg_begin (); it !=
             md->getMacroInfo()->arg_end (); it++) {
           // Assemble the macro arguments in a list and check names for illegal underscores. 
@@ -201,23 +206,22 @@ string MacroFormatter::getFortranMacroASString() {
             CToFTypeFormatter::PrependError(macroName, args, sloc);
             argname = "h2m" + argname;  // Fix the illegal name problem by prepending h2m
           }
-          fortranMacro += argname;  // Add the new argument into the subroutine's definition.
-          fortranMacro += ", ";
+          arguments += argname;  // Add the new argument into the subroutine's definition.
+          arguments += ", ";
         }
         // erase the redundant comma and space at the end of the macro
-        fortranMacro.erase(fortranMacro.size()-2);
-        fortranMacro += ") BIND(C)\n";
+        arguments.erase(arguments.size()-2);
+        fortranMacro += arguments + ") BIND(C)\n";
       }
-      // Comment out the body of the function using the standard string-stream idiom.
+      // Comment out the body of the function. The buffer knows where its lines are.
       if (!functionBody.empty()) {
-        std::istringstream in(functionBody);
-        // Iterate through the function body line by line.
-        for (std::string line; std::getline(in, line);) {
-          if (args.getSilent() == false && args.getQuiet() == false) {
-            errs() << "Warning: line " << line << " commented out.\n";
-            CToFTypeFormatter::LineError(sloc);
+        size_t first_line = fortranMacro.getLineCount();
+        fortranMacro.appendCommentedOut(functionBody);
+        if (args.getSilent() == false && args.getQuiet() == false) {
+          for (size_t i = first_line; i < fortranMacro.getLineCount(); i++) {
+            CToFTypeFormatter::Warn(CToFTypeFormatter::COMMENTED_OUT, "Warning: line " +
+                fortranMacro.getLine(i).drop_front(2).str() + " commented out.", sloc, args);
           }
-          fortranMacro += "! " + line + "\n";
         }
       }
       fortranMacro += "END SUBROUTINE " + actual_macroName + "\n";
@@ -232,21 +236,13 @@ string MacroFormatter::getFortranMacroASString() {
       error_string = actual_macroName + ", macro name.";
     }
     // Now check to see if this is a repeated identifier. This is very uncommon but could occur.
-    if (RecordDeclFormatter::StructAndTypedefGuard(actual_macroName) == false) {
+    string original;
+    if (RecordDeclFormatter::StructAndTypedefGuard(actual_macroName, args, "macro", sloc,
+        original) == false) {
       current_status = CToFTypeFormatter::DUPLICATE;
-      error_string = actual_macroName + ", macro name.";
-    }
-    // Check line lengths on all macro lines. It is best do do this in one place.
-    std::istringstream in(fortranMacro);
-    // Iterate through the macro line by line with the
-    // standard string stream logic.
-    for (std::string line; std::getline(in, line);) {
-      if (line.length() > CToFTypeFormatter::line_max) {
-        current_status = CToFTypeFormatter::BAD_LINE_LENGTH;
-        error_string = actual_macroName + ", " + line;
-      }
+      error_string = actual_macroName + ", macro name, " + original + ".";
     }
   }
-  return fortranMacro;
+  return fortranMacro.str();
 };
 
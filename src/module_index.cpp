@@ -0,0 +1,199 @@
+// This file contains the ModuleIndex class for the h2m translator.
+// It records which module declares each identifier during a recursive run
+// and writes the USE... ONLY statements each module needs from the others.
+
+#include "h2m.h"
+
+void ModuleIndex::AddModule(const string &module_name, const std::vector<string> &declared,
+    bool linked) {
+  Module module;
+  module.name = module_name;
+  module.linked = linked;
+  unsigned id = modules.size();
+  modules.push_back(module);
+  for (const string &name : declared) {
+    owners.insert(std::make_pair(name, id));  // An earlier owner is kept.
+  }
+}
+
+// Only the places a declaration can take something from another module are looked
+// in: anything in parentheses, which covers a type (ie TYPE(my_struct)), a kind
+// and the bounds of an array (ie DIMENSION(buf_len), or my_array(buf_len)), and
+// initialization expressions, which follow an "=" outside any parentheses. Every
+// other name is one being declared, a component or a keyword (ie VALUE), so it must
+// not be imported. Neither are the contents of BIND(...), keyword arguments (ie
+// kind=) or a procedure's dummy arguments, which are collected from its FUNCTION
+// or SUBROUTINE statement and passed over (ie in DIMENSION(x+4)) until its END.
+// The text is gone through once. Identifiers are looked up as they are found, so
+// the references need not be collected first. A character literal continued onto
+// the next line (see TranslationWriter) is still a literal there, but a quote left
+// open at the end of any other line is taken to be a mistake and forgotten.
+void ModuleIndex::FindReferences(StringRef text, const StringSet<> &own,
+    std::map<unsigned, std::set<string>> &needed) const {
+  char quote = 0;  // The quote which opened the literal we are inside, if any.
+  bool component = false;  // Whether the last thing seen was a "%".
+  unsigned depth = 0;  // Of the parentheses open in this statement.
+  bool initialization = false;  // Whether an "=" has been seen in this statement.
+  bool statement_start = true;  // Whether no word has been seen in this statement.
+  // The parentheses whose contents are passed over (BIND or the dummy arguments),
+  // which the next "(" opens, and the depth of those we are inside, if any.
+  bool bind_next = false;
+  bool dummies_next = false;
+  unsigned skip_depth = 0;
+  bool in_dummies = false;
+  StringSet<> dummies;  // Of the procedure being declared, if any.
+  char last = 0;  // The last thing on the line before any comment.
+  SmallString<64> folded;  // Used again for every identifier.
+  size_t i = 0;
+  while (i < text.size()) {
+    char c = text[i];
+    if (c != ' ' && c != '\n' && (c != '!' || quote != 0)) {
+      last = c;
+    }
+    if (c == '\n') {
+      bool continued = last == '&';  // There may be a comment after the "&".
+      last = 0;
+      if (continued == false) {  // The statement is over.
+        quote = 0;
+        depth = 0;
+        initialization = false;
+        statement_start = true;
+        bind_next = false;
+        dummies_next = false;
+        skip_depth = 0;
+      }
+      component = false;
+      i++;
+    } else if (quote != 0) {
+      if (c == quote) {
+        quote = 0;
+      }
+      i++;
+    } else if (c == '\'' || c == '"') {
+      quote = c;
+      i++;
+    } else if (c == '!') {  // The rest of the line is a comment.
+      i = text.find('\n', i);
+      if (i == StringRef::npos) {
+        break;
+      }
+    } else if (isalnum(static_cast<unsigned char>(c))) {
+      size_t start = i;
+      while (i < text.size() && (isalnum(static_cast<unsigned char>(text[i])) ||
+          text[i] == '_')) {
+        i++;
+      }
+      size_t after = text.find_first_not_of(' ', i);
+      char next = after == StringRef::npos ? '\0' : text[after];
+      bool keyword_argument = next == '=' && (after + 1 == text.size() ||
+          text[after + 1] != '=');
+      // A number (with its kind) or the name of a component is never one of ours.
+      if (isalpha(static_cast<unsigned char>(c)) && component == false) {
+        StringRef name = SymbolTable::Fold(text.slice(start, i), folded);
+        if (skip_depth != 0) {
+          if (in_dummies == true) {
+            dummies.insert(name);
+          }
+        } else if (depth == 0 && initialization == false) {
+          if (statement_start == true && name == "end") {
+            dummies.clear();
+          } else if (name == "function" || name == "subroutine") {
+            dummies.clear();
+            dummies_next = true;
+          } else if (name == "bind" && next == '(') {
+            bind_next = true;
+          }
+        } else if (keyword_argument == false && dummies.count(name) == 0) {
+          StringMap<unsigned>::const_iterator owner = owners.find(name);
+          if (owner != owners.end() && own.count(name) == 0) {
+            needed[owner->second].insert(name.str());
+          }
+        }
+        statement_start = false;
+      }
+      component = false;
+    } else {
+      if (c == '(') {
+        depth++;
+        if (skip_depth == 0 && (bind_next == true || dummies_next == true)) {
+          skip_depth = depth;
+          in_dummies = dummies_next;
+          bind_next = false;
+          dummies_next = false;
+        }
+      } else if (c == ')') {
+        if (depth == skip_depth) {
+          skip_depth = 0;
+        }
+        if (depth > 0) {
+          depth--;
+        }
+      } else if (c == '=' && depth == 0) {
+        initialization = true;
+      }
+      if (c != ' ') {
+        component = c == '%';
+      }
+      i++;
+    }
+  }
+}
+
+string ModuleIndex::UseStatements(ArrayRef<StringRef> texts,
+    const std::vector<string> &declared) const {
+  string statements;
+  // Everything in a module is public, so a module which USEs all the ones before it
+  // passes all their names on to whatever USEs it in turn.
+  if (use_all == true) {
+    for (const Module &module : modules) {
+      statements += (module.linked ? "USE " : "! USE ") + module.name + "\n";
+    }
+    return statements;
+  }
+
+  StringSet<> own;
+  for (const string &name : declared) {
+    own.insert(name);
+  }
+  // The identifiers needed from each module, by its place in modules. The pieces
+  // are all one module, so each module is only named once.
+  std::map<unsigned, std::set<string>> needed;
+  for (StringRef text : texts) {
+    FindReferences(text, own, needed);
+  }
+
+  // The statements are written like any other translation, so a long list of
+  // names is continued over several lines. Each continuation line holds at least
+  // this much of the list, since a name is never longer than name_max, so a longer
+  // list is begun again in another USE statement for the same module before it
+  // could need more than continuation_max of them. A module with errors is still
+  // named (commented out) so that it is clear what would have been used from it.
+  const size_t piece_min = CToFTypeFormatter::line_max - CToFTypeFormatter::name_max - 8;
+  const size_t list_max = piece_min * (CToFTypeFormatter::continuation_max - 2);
+  raw_string_ostream out(statements);
+  {
+    TranslationWriter writer(out);
+    for (const std::pair<const unsigned, std::set<string>> &module : needed) {
+      writer.setCommentOut(modules[module.first].linked == false);
+      size_t length = 0;
+      for (const string &name : module.second) {
+        if (length == 0) {
+          writer << "USE " << modules[module.first].name << ", ONLY: ";
+        } else {
+          writer << ", ";
+        }
+        writer << name;
+        length += name.size() + 2;
+        if (length > list_max) {
+          writer << "\n";
+          length = 0;
+        }
+      }
+      if (length != 0) {
+        writer << "\n";
+      }
+    }
+  }
+  out.flush();
+  return statements;
+}
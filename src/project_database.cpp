@@ -0,0 +1,49 @@
+// This file contains the ProjectDatabase class for the h2m
+// translator. It lets the headers of a whole project be translated
+// with the flags their project's build actually uses.
+
+#include "h2m.h"
+
+// Makes a path from a compile command absolute, using the directory the command
+// is run in, and tidies it up so that paths can be compared.
+static string MakeAbsolute(const string &directory, StringRef path) {
+  SmallString<256> absolute;
+  if (sys::path::is_relative(path)) {
+    absolute = directory;
+    sys::path::append(absolute, path);
+  } else {
+    absolute = path;
+  }
+  sys::path::remove_dots(absolute, true);
+  return absolute.str();
+}
+
+void ProjectDatabase::AddHeader(const string &header, const string &source) {
+  header_sources.insert(std::make_pair(header, source));
+}
+
+// The source's name is found in its command by comparing absolute paths, since
+// the command may name it relative to the directory it is run in.
+std::vector<CompileCommand> ProjectDatabase::getCompileCommands(
+    StringRef FilePath) const {
+  auto found = header_sources.find(FilePath.str());
+  if (found == header_sources.end()) {
+    return database->getCompileCommands(FilePath);
+  }
+  std::vector<CompileCommand> commands = database->getCompileCommands(found->second);
+  // A source compiled more than once only needs its header parsed once.
+  if (commands.size() > 1) {
+    commands.resize(1);
+  }
+  for (CompileCommand &command : commands) {
+    string source = MakeAbsolute(command.Directory, command.Filename);
+    // The first argument is the compiler itself.
+    for (size_t i = 1; i < command.CommandLine.size(); i++) {
+      if (MakeAbsolute(command.Directory, command.CommandLine[i]) == source) {
+        command.CommandLine[i] = FilePath.str();
+      }
+    }
+    command.Filename = FilePath.str();
+  }
+  return commands;
+}
@@ -0,0 +1,87 @@
+// This file contains the SymbolTable class for the h2m translator.
+// It records the Fortran names declared in each module so that duplicate
+// identifiers can be caught, and the warning can say where the first one was.
+
+#include "h2m.h"
+
+void SymbolTable::setScope(StringRef scope) {
+  StringMap<unsigned>::iterator found = scope_ids.find(scope);
+  if (found != scope_ids.end()) {
+    current = found->second;
+    return;
+  }
+  current = scopes.size();
+  scope_ids[scope] = current;
+  scopes.emplace_back();
+}
+
+// The first declaration is the one kept. The later ones are only warned about.
+// A name first declared in another scope is not declared again in this one.
+const SymbolTable::Symbol *SymbolTable::Declare(StringRef folded, const char *kind,
+    PresumedLoc sloc) {
+  StringMap<Symbol>::iterator found = scopes[current].find(folded);
+  if (found != scopes[current].end()) {
+    return &found->second;
+  }
+  if (chained == true) {
+    found = earlier.find(folded);
+    if (found != earlier.end()) {
+      return &found->second;
+    }
+  }
+  Symbol symbol;
+  symbol.kind = kind;
+  symbol.line = 0;
+  if (sloc.isValid()) {
+    symbol.file = sloc.getFilename();
+    symbol.line = sloc.getLine();
+  }
+  scopes[current][folded] = symbol;
+  if (chained == true) {
+    earlier[folded] = symbol;
+  }
+  return nullptr;
+}
+
+void SymbolTable::getNames(StringRef scope, std::vector<string> &names) const {
+  StringMap<unsigned>::const_iterator found = scope_ids.find(scope);
+  if (found == scope_ids.end()) {
+    return;
+  }
+  for (const StringMapEntry<Symbol> &symbol : scopes[found->second]) {
+    names.push_back(symbol.getKey());
+  }
+}
+
+// The unnamed scope is always there, because that is the one used when no
+// scope has been set (ie during a -together run).
+void SymbolTable::clear() {
+  scopes.clear();
+  scope_ids.clear();
+  earlier.clear();
+  setScope("");
+}
+
+// Fortran is not case sensitive, but identifiers are only ever ASCII, so there
+// is no need for the locale here.
+StringRef SymbolTable::Fold(StringRef name, SmallVectorImpl<char> &buffer) {
+  buffer.resize(name.size());
+  for (size_t i = 0; i < name.size(); i++) {
+    char c = name[i];
+    buffer[i] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+  }
+  return StringRef(buffer.data(), buffer.size());
+}
+
+string SymbolTable::Describe(const Symbol &symbol) {
+  string description = "first declared";
+  if (symbol.kind[0] != '\0') {
+    description += string(" as a ") + symbol.kind;
+  }
+  if (symbol.file.empty() == false) {
+    description += " at " + symbol.file + " Line " + std::to_string(symbol.line);
+  } else {
+    description += " earlier";
+  }
+  return description;
+}
@@ -0,0 +1,100 @@
+// This file contains the TimeReport class for the h2m translator.
+// It records the time spent in each phase of a run, in total and
+// for each header, for the timing report (-time-report).
+
+#include "h2m.h"
+
+// The names and descriptions of the phases, in the order of TimeReport::Phase.
+static const char *PhaseNames[TimeReport::NUM_PHASES][2] = {
+  {"trace", "Include trace"},
+  {"parse", "Clang tool run (parsing)"},
+  {"traverse", "AST traversal (TraverseDecl)"},
+  {"function", "FunctionDeclFormatter"},
+  {"var", "VarDeclFormatter"},
+  {"record", "RecordDeclFormatter"},
+  {"enum", "EnumDeclFormatter"},
+  {"typedef", "TypedefDeclFormater"},
+  {"macro", "MacroFormatter"},
+  {"emit", "EmitTranslationAndErrors"},
+  {"output", "Output writing"}
+};
+
+TimeReport::TimeReport() {
+  totals = MakeGroup("h2m", "h2m time report, all files");
+}
+
+std::unique_ptr<TimeReport::Group> TimeReport::MakeGroup(const string &name,
+    const string &description) {
+  std::unique_ptr<Group> made(new Group);
+  made->group.reset(new TimerGroup(name, description));
+  for (int i = 0; i < NUM_PHASES; i++) {
+    made->timers.emplace_back(new Timer(PhaseNames[i][0], PhaseNames[i][1],
+        *made->group));
+  }
+  return made;
+}
+
+void TimeReport::BeginHeader(const string &headerfile) {
+  // Anything still timing is charged to the old header up to now.
+  if (running.empty() == false) {
+    StopTimers(running.back());
+  }
+  headers.push_back(MakeGroup("h2m-" + std::to_string(headers.size()),
+      "h2m time report for " + headerfile));
+  current = headers.back().get();
+  if (running.empty() == false) {
+    StartTimers(running.back());
+  }
+}
+
+void TimeReport::EndHeader() {
+  if (running.empty() == false) {
+    StopTimers(running.back());
+  }
+  current = nullptr;
+  if (running.empty() == false) {
+    StartTimers(running.back());
+  }
+}
+
+// The phase the new one is started inside of is paused until it stops again.
+void TimeReport::Start(Phase phase) {
+  if (running.empty() == false) {
+    StopTimers(running.back());
+  }
+  running.push_back(phase);
+  StartTimers(phase);
+}
+
+void TimeReport::Stop(Phase phase) {
+  if (running.empty() == true || running.back() != phase) {
+    return;  // This would be a mistake in the calls. Don't make it worse.
+  }
+  StopTimers(phase);
+  running.pop_back();
+  if (running.empty() == false) {
+    StartTimers(running.back());
+  }
+}
+
+void TimeReport::StartTimers(Phase phase) {
+  totals->timers[phase]->startTimer();
+  if (current != nullptr) {
+    current->timers[phase]->startTimer();
+  }
+}
+
+void TimeReport::StopTimers(Phase phase) {
+  totals->timers[phase]->stopTimer();
+  if (current != nullptr) {
+    current->timers[phase]->stopTimer();
+  }
+}
+
+// Printing a TimerGroup also clears it, so nothing is printed twice.
+void TimeReport::Print(raw_ostream &out) {
+  for (std::unique_ptr<Group> &header : headers) {
+    header->group->print(out);
+  }
+  totals->group->print(out);
+}
@@ -0,0 +1,66 @@
+// This file contains the TimeTrace class for the h2m translator.
+// It records spans of time during a run and writes them out in
+// Chrome's trace-event format (-time-trace).
+
+#include "h2m.h"
+
+void TimeTrace::AddSpan(const string &name, const string &detail,
+    std::chrono::steady_clock::time_point begin) {
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  Span span;
+  span.name = name;
+  span.detail = detail;
+  span.begin = std::chrono::duration_cast<std::chrono::microseconds>(
+      begin - start).count();
+  span.duration = std::chrono::duration_cast<std::chrono::microseconds>(
+      end - begin).count();
+  std::lock_guard<std::mutex> guard(lock);
+  std::thread::id id = std::this_thread::get_id();
+  if (threads.count(id) == 0) {
+    unsigned number = threads.size();
+    threads[id] = number;
+  }
+  span.thread = threads[id];
+  spans.push_back(span);
+}
+
+// The file is a JSON object holding an array of events. The spans are written
+// first, then a metadata event naming each thread's track.
+bool TimeTrace::Write(const string &filename) {
+  std::error_code error;
+  raw_fd_ostream out(filename, error, sys::fs::F_Text);
+  if (error) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  out << "{\"traceEvents\":[\n";
+  bool first = true;
+  for (const Span &span : spans) {
+    if (first == false) {
+      out << ",\n";
+    }
+    first = false;
+    out << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << span.thread;
+    out << ",\"ts\":" << span.begin << ",\"dur\":" << span.duration;
+    out << ",\"name\":\"" << EscapeJSON(span.name) << "\"";
+    if (span.detail.empty() == false) {
+      out << ",\"args\":{\"detail\":\"" << EscapeJSON(span.detail) << "\"}";
+    }
+    out << "}";
+  }
+  for (const std::pair<const std::thread::id, unsigned> &thread : threads) {
+    if (first == false) {
+      out << ",\n";
+    }
+    first = false;
+    out << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.second;
+    out << ",\"name\":\"thread_name\",\"args\":{\"name\":\"";
+    out << (thread.second == 0 ? string("h2m") : "worker " + std::to_string(thread.second));
+    out << "\"}}";
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  out.close();
+  bool failed = out.has_error();
+  out.clear_error();  // Otherwise the stream would report it again, fatally
+  return failed == false;
+}
@@ -0,0 +1,319 @@
+// This file contains the TranslationCache class for the h2m
+// translator. It allows the modules translated by one run to be
+// reused by a later run when nothing they depend on has changed.
+
+#include "h2m.h"
+
+// The first line of every entry, and of a manifest. Change the number if
+// the format changes so that old entries are simply treated as misses.
+static const char *EntryHeader = "h2m-cache 1";
+static const char *ManifestHeader = "h2m-manifest 1";
+
+// A manifest is read in full when the cache is created. A missing manifest is
+// not a problem (this is the first run). A damaged one is simply ignored past
+// the point of the damage, meaning those headers are translated again.
+TranslationCache::TranslationCache(string location,
+    IntrusiveRefCntPtr<CachingFileSystem> fs, bool is_manifest) :
+    directory(location), files(fs), manifest(is_manifest) {
+  if (manifest == false) {
+    return;
+  }
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> contents =
+      llvm::MemoryBuffer::getFile(directory);
+  if (!contents) {
+    return;
+  }
+  StringRef rest = (*contents)->getBuffer();
+  std::pair<StringRef, StringRef> split = rest.split('\n');
+  if (split.first != ManifestHeader) {
+    return;
+  }
+  rest = split.second;
+  while (rest.empty() == false) {
+    Entry entry;
+    if (ReadEntry(rest, entry) == false) {
+      break;
+    }
+    old_entries[entry.header] = entry;
+  }
+}
+
+// Hashes the contents of a file, reading it through the shared file system cache.
+string TranslationCache::HashFile(const string &path) {
+  llvm::ErrorOr<std::unique_ptr<vfs::File>> opened = files->openFileForRead(path);
+  if (!opened) {
+    return "";
+  }
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = (*opened)->getBuffer(path);
+  if (!buffer) {
+    return "";
+  }
+  MD5 hash;
+  hash.update((*buffer)->getBuffer());
+  MD5::MD5Result result;
+  hash.final(result);
+  SmallString<32> hex;
+  MD5::stringifyResult(result, hex);
+  return hex.str();
+}
+
+// The key covers everything known before the header is parsed: the Clang version,
+// the options which change the translated text, the command line the header will be
+// parsed with (plus any extra arguments, ie a precompiled header) and the name and
+// contents of the header itself. What the header includes is only known after a
+// parse, so that is checked when the entry is looked up instead.
+string TranslationCache::getKey(const string &headerfile, Arguments &args,
+    CompilationDatabase &Compilations, const std::vector<string> &extra_args) {
+  string path = getAbsolutePath(headerfile);
+  MD5 hash;
+  hash.update(getClangFullVersion());
+  hash.update(args.getFlagsString());
+  for (const CompileCommand &command : Compilations.getCompileCommands(path)) {
+    // The first argument is the name of the tool, and it doesn't matter.
+    for (size_t i = 1; i < command.CommandLine.size(); i++) {
+      hash.update(command.CommandLine[i]);
+      hash.update(StringRef("\0", 1));  // Keeps "-I a" and "-Ia" apart
+    }
+  }
+  for (const string &arg : extra_args) {
+    hash.update(arg);
+    hash.update(StringRef("\0", 1));
+  }
+  hash.update(path);
+  hash.update(HashFile(path));
+  MD5::MD5Result result;
+  hash.final(result);
+  SmallString<32> hex;
+  MD5::stringifyResult(result, hex);
+  return hex.str();
+}
+
+// An entry is a small piece of text:
+//   h2m-cache 1
+//   header <path>                 (the header translated)
+//   module <name>                 (the name its module was given)
+//   key <key>                     (see getKey)
+//   dependency <hash> <path>      (one for each file the translation read)
+//   guard <0 or 1> <identifier>   (one for each duplicate check, in order)
+//   body <number of characters>
+// followed by the body of the module itself. The entry is removed from the
+// front of the text given. False is returned if it can't be read.
+bool TranslationCache::ReadEntry(StringRef &rest, Entry &entry) {
+  bool first = true;
+  while (rest.empty() == false) {
+    std::pair<StringRef, StringRef> split = rest.split('\n');
+    StringRef line = split.first;
+    rest = split.second;
+    if (first == true) {  // Make sure this is an entry we know how to read.
+      first = false;
+      if (line != EntryHeader) {
+        return false;
+      }
+    } else if (line.startswith("header ")) {
+      entry.header = line.drop_front(7).str();
+    } else if (line.startswith("module ")) {
+      entry.module_name = line.drop_front(7).str();
+    } else if (line.startswith("key ")) {
+      entry.key = line.drop_front(4).str();
+    } else if (line.startswith("dependency ")) {
+      std::pair<StringRef, StringRef> fields = line.drop_front(11).split(' ');
+      entry.dependencies.push_back(std::make_pair(fields.first.str(),
+          fields.second.str()));
+    } else if (line.startswith("guard ")) {
+      StringRef fields = line.drop_front(6);
+      entry.log.push_back(std::make_pair(fields.drop_front(2).str(),
+          fields.startswith("1")));
+    } else if (line.startswith("body ")) {
+      size_t length = 0;
+      if (line.drop_front(5).getAsInteger(10, length) == true || length > rest.size()) {
+        return false;
+      }
+      entry.body = rest.substr(0, length).str();
+      rest = rest.drop_front(length);
+      return true;
+    } else {  // Something unexpected, the entry may be damaged.
+      return false;
+    }
+  }
+  return false;  // The body never came.
+}
+
+// The reverse of ReadEntry.
+string TranslationCache::WriteEntry(const Entry &entry) {
+  string contents = string(EntryHeader) + "\n";
+  contents += "header " + entry.header + "\n";
+  contents += "module " + entry.module_name + "\n";
+  contents += "key " + entry.key + "\n";
+  for (const std::pair<string, string> &dependency : entry.dependencies) {
+    contents += "dependency " + dependency.first + " " + dependency.second + "\n";
+  }
+  for (const std::pair<string, bool> &check : entry.log) {
+    contents += string("guard ") + (check.second ? "1 " : "0 ") + check.first + "\n";
+  }
+  contents += "body " + std::to_string(entry.body.size()) + "\n";
+  contents += entry.body;
+  return contents;
+}
+
+// Decides whether an entry is still good and, if it is, copies it into the
+// translation as though the translation had just been done.
+bool TranslationCache::UseEntry(const Entry &entry, ModuleTranslation &translation,
+    Arguments &args) {
+  // If any file read has changed (or vanished) the entry is no good.
+  for (const std::pair<string, string> &dependency : entry.dependencies) {
+    if (HashFile(dependency.second) != dependency.first) {
+      return false;
+    }
+  }
+  // The translation commented out the identifiers it found to be duplicates. Make
+  // sure the same identifiers would still be found to be duplicates (and no others)
+  // given what has been declared in this module's scope so far.
+  SymbolTable &symbols = args.getSymbols();
+  std::set<string> added;
+  for (const std::pair<string, bool> &check : entry.log) {
+    bool is_new = symbols.isDeclared(check.first) == false && added.count(check.first) == 0;
+    if (is_new != check.second) {
+      return false;
+    }
+    added.insert(check.first);
+  }
+  // Where these were declared isn't cached, so they are only known to be earlier.
+  for (const string &name : added) {
+    symbols.Declare(name, "", PresumedLoc());
+  }
+  if (args.getGuardLog() != nullptr) {
+    args.getGuardLog()->insert(args.getGuardLog()->end(), entry.log.begin(),
+        entry.log.end());
+  }
+  translation.body = entry.body;
+  translation.dependencies.clear();
+  for (const std::pair<string, string> &dependency : entry.dependencies) {
+    translation.dependencies.insert(dependency.second);
+  }
+  translation.started = true;
+  translation.tool_errors = 0;
+  translation.from_cache = true;
+  return true;
+}
+
+// In a cache directory the entry is found by its key. In a manifest, the entry is
+// found by the header's name, and it must have the same key and module name.
+bool TranslationCache::Lookup(const string &key, ModuleTranslation &translation,
+    Arguments &args) {
+  Entry entry;
+  bool found = false;
+  if (manifest == true) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto old = old_entries.find(translation.headerfile);
+    if (old != old_entries.end() && old->second.key == key &&
+        old->second.module_name == translation.module_name) {
+      entry = old->second;
+      found = true;
+    }
+  } else {
+    SmallString<256> entry_path(directory);
+    sys::path::append(entry_path, key + ".h2m");
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> contents =
+        llvm::MemoryBuffer::getFile(entry_path);
+    if (contents) {  // No such entry is the usual miss.
+      StringRef rest = (*contents)->getBuffer();
+      found = ReadEntry(rest, entry);
+    }
+  }
+  if (found == false || UseEntry(entry, translation, args) == false) {
+    misses++;
+    return false;
+  }
+  hits++;
+  if (manifest == true) {  // Keep it for the next run, too.
+    std::lock_guard<std::mutex> guard(lock);
+    new_entries[translation.headerfile] = entry;
+  }
+  return true;
+}
+
+// Makes the entry for a successful translation. A manifest keeps it in memory
+// until SaveManifest is called. A cache directory gets a file for it right away,
+// which is written to a temporary file and renamed into place so that an entry
+// is never seen half written, even by a run happening at the same time.
+void TranslationCache::Store(const string &key, const ModuleTranslation &translation,
+    const GuardLog &log, Arguments &args) {
+  Entry entry;
+  entry.header = translation.headerfile;
+  entry.module_name = translation.module_name;
+  entry.key = key;
+  for (const string &dependency : translation.dependencies) {
+    string hash = HashFile(dependency);
+    if (hash.empty() == true) {
+      return;  // A dependency can't be read. It would never be valid.
+    }
+    entry.dependencies.push_back(std::make_pair(hash, dependency));
+  }
+  entry.log = log;
+  entry.body = translation.body;
+  if (manifest == true) {
+    std::lock_guard<std::mutex> guard(lock);
+    new_entries[translation.headerfile] = entry;
+    return;
+  }
+
+  std::error_code error = sys::fs::create_directories(directory);
+  if (error) {
+    if (args.getSilent() == false) {
+      errs() << "Warning: unable to create translation cache directory " << directory;
+      errs() << ": " << error.message() << "\n";
+    }
+    return;
+  }
+  SmallString<256> entry_path(directory);
+  sys::path::append(entry_path, key + ".h2m");
+  if (WriteFileAtomically(entry_path.str(), WriteEntry(entry)) == false &&
+      args.getSilent() == false) {
+    errs() << "Warning: unable to write translation cache entry for ";
+    errs() << translation.headerfile << "\n";
+  }
+}
+
+// Replaces the manifest with the entries used or made by this run. Headers which
+// were not translated successfully have no entry, so they are tried again next time.
+bool TranslationCache::SaveManifest(Arguments &args) {
+  string contents = string(ManifestHeader) + "\n";
+  for (const std::pair<const string, Entry> &entry : new_entries) {
+    contents += WriteEntry(entry.second);
+  }
+  if (WriteFileAtomically(directory, contents) == false) {
+    if (args.getSilent() == false) {
+      errs() << "Warning: unable to write incremental manifest " << directory << "\n";
+    }
+    return false;
+  }
+  return true;
+}
+
+// Writes the contents to a temporary file beside the path and renames it into place.
+bool TranslationCache::WriteFileAtomically(const string &path, const string &contents) {
+  SmallString<256> temp_path;
+  int fd;
+  std::error_code error = sys::fs::createUniqueFile(Twine(path) + ".%%%%%%.tmp", fd,
+      temp_path);
+  if (error) {
+    return false;
+  }
+  {
+    raw_fd_ostream out(fd, true);
+    out << contents;
+    out.close();
+    if (out.has_error()) {
+      out.clear_error();
+      error = std::make_error_code(std::errc::io_error);
+    }
+  }
+  if (!error) {
+    error = sys::fs::rename(temp_path, path);
+  }
+  if (error) {
+    sys::fs::remove(temp_path);
+    return false;
+  }
+  return true;
+}
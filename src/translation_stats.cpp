@@ -0,0 +1,70 @@
+// This file contains the TranslationStats structure for the h2m
+// translator. It keeps the counts written to the statistics file
+// of a run (-stats-json).
+
+#include "h2m.h"
+
+// The names of the status codes, in the order of CToFTypeFormatter::status.
+static const char *StatusNames[CToFTypeFormatter::BAD_ARRAY + 1] = {
+  "OKAY", "FUNC_MACRO", "BAD_ANON", "BAD_LINE_LENGTH", "BAD_TYPE",
+  "BAD_NAME_LENGTH", "BAD_STRUCT_TRANS", "BAD_STAR_ARRAY", "DUPLICATE",
+  "U_OR_L_MACRO", "UNKNOWN_VAR", "CRIT_ERROR", "BAD_MACRO", "BAD_ARRAY"
+};
+
+const char *TranslationStats::getStatusName(int status) {
+  if (status < CToFTypeFormatter::OKAY || status > CToFTypeFormatter::BAD_ARRAY) {
+    return "UNKNOWN";
+  }
+  return StatusNames[status];
+}
+
+void TranslationStats::Add(const TranslationStats &other) {
+  for (const std::pair<const string, unsigned> &kind : other.declarations) {
+    declarations[kind.first] += kind.second;
+  }
+  skipped_not_main += other.skipped_not_main;
+  skipped_system += other.skipped_system;
+  for (int i = 0; i <= CToFTypeFormatter::BAD_ARRAY; i++) {
+    statuses[i] += other.statuses[i];
+    commented_out[i] += other.commented_out[i];
+  }
+  macros_processed += other.macros_processed;
+  macros_emitted += other.macros_emitted;
+  bytes_emitted += other.bytes_emitted;
+}
+
+// Writes one of the status count arrays as a JSON object. Codes which never
+// came up are left out.
+static void WriteStatusCounts(raw_ostream &out, const unsigned counts[]) {
+  out << "{";
+  bool first = true;
+  for (int i = 0; i <= CToFTypeFormatter::BAD_ARRAY; i++) {
+    if (counts[i] == 0) {
+      continue;
+    }
+    out << (first ? "" : ", ") << "\"" << StatusNames[i] << "\": " << counts[i];
+    first = false;
+  }
+  out << "}";
+}
+
+void TranslationStats::WriteJSON(raw_ostream &out, const string &indent) const {
+  out << indent << "\"declarations\": {";
+  bool first = true;
+  for (const std::pair<const string, unsigned> &kind : declarations) {
+    out << (first ? "" : ", ") << "\"" << EscapeJSON(kind.first) << "\": " << kind.second;
+    first = false;
+  }
+  out << "},\n";
+  out << indent << "\"skipped_not_main_file\": " << skipped_not_main << ",\n";
+  out << indent << "\"skipped_system_header\": " << skipped_system << ",\n";
+  out << indent << "\"statuses\": ";
+  WriteStatusCounts(out, statuses);
+  out << ",\n";
+  out << indent << "\"commented_out\": ";
+  WriteStatusCounts(out, commented_out);
+  out << ",\n";
+  out << indent << "\"macros_processed\": " << macros_processed << ",\n";
+  out << indent << "\"macros_emitted\": " << macros_emitted << ",\n";
+  out << indent << "\"bytes_emitted\": " << bytes_emitted;
+}
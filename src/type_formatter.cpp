@@ -2,6 +2,7 @@
 // for the h2m autofortran tool. 
 
 #include "h2m.h"
+#include "llvm/ADT/StringSwitch.h"
 
 // A helper function to be used to output error line information
 // If the location is invalid, it returns a message about that.
@@ -13,44 +14,228 @@ void CToFTypeFormatter::CToFTypeFormatter::LineError(PresumedLoc sloc) {
   }
 }
 
+// Without a Diagnostics object (ie in the benchmark) this is the old pair of
+// writes to standard error.
+void CToFTypeFormatter::Report(status current_status, const string &message,
+    PresumedLoc sloc, Arguments &args) {
+  Diagnostics *diagnostics = args.getDiagnostics();
+  if (diagnostics != nullptr) {
+    diagnostics->Report(current_status, message, sloc);
+  } else {
+    errs() << message << "\n";
+    LineError(sloc);
+  }
+}
+
+const char *const CToFTypeFormatter::RENAMED = "RENAMED";
+const char *const CToFTypeFormatter::EMPTY_STRUCT = "EMPTY_STRUCT";
+const char *const CToFTypeFormatter::COMMENTED_OUT = "COMMENTED_OUT";
+const char *const CToFTypeFormatter::ARRAY_DIMENSIONS = "ARRAY_DIMENSIONS";
+const char *const CToFTypeFormatter::NULL_POINTER = "NULL_POINTER";
+const char *const CToFTypeFormatter::UNKNOWN_DECL = "UNKNOWN_DECL";
+
+void CToFTypeFormatter::Warn(const char *rule, const string &message,
+    PresumedLoc sloc, Arguments &args) {
+  Diagnostics *diagnostics = args.getDiagnostics();
+  if (diagnostics != nullptr) {
+    diagnostics->Warn(rule, message, sloc);
+  } else {
+    errs() << message << "\n";
+    LineError(sloc);
+  }
+}
+
 // This little helper outputs an error relating to prepending h2m to the
 // front of an identifier, if needed. It's nice to have a generic
 // error message in one place.
 void CToFTypeFormatter::PrependError(const string identifier, Arguments& args,
     PresumedLoc sloc) {
   if (args.getSilent() == false) {
-    errs() << "Warning: Fortran identifiers may not begin with an underscore. " <<
-        identifier << " renamed h2m" << identifier << "\n";
-    LineError(sloc);
+    Warn(RENAMED, "Warning: Fortran identifiers may not begin with an underscore. " +
+        identifier + " renamed h2m" + identifier, sloc, args);
   }
 }
 
+// Decides whether something at loc belongs to a system header which must be kept
+// out of the translation. In a normal run, system headers are always excluded
+// because they are the main file of their own run if they are translated at all.
+// During a single-parse recursive run, everything is seen in one parse, so system
+// headers are only excluded if the user asked for them to be (-n).
+bool CToFTypeFormatter::isExcludedSystemHeader(SourceLocation loc, SourceManager &sm,
+    Arguments &args) {
+  if (sm.isInSystemHeader(loc) == false) {
+    return false;
+  }
+  return args.getSplitter() == nullptr || args.getNoSystemHeaders() == true;
+}
+
+
+// Writes text through to the stream given, starting every line with "! " while
+// commenting out. Lines are commented as the text passes through, so nothing is
+// copied on the way.
+void TranslationWriter::write_impl(const char *ptr, size_t size) {
+  const char *end = ptr + size;
+  while (ptr < end) {
+    const char *newline = static_cast<const char *>(memchr(ptr, '\n', end - ptr));
+    const char *stop = newline != nullptr ? newline + 1 : end;
+    if (comment_out == true) {
+      if (line_start == true) {
+        out << "! ";
+      }
+      out.write(ptr, stop - ptr);
+    } else if (newline == nullptr) {  // The rest of this line is still to come.
+      pending.append(ptr, end - ptr);
+    } else if (pending.empty() == true) {  // A whole line, which needs no copy.
+      WriteLine(StringRef(ptr, newline - ptr));
+      out << "\n";
+    } else {
+      pending.append(ptr, newline - ptr);
+      WriteLine(pending);
+      pending.clear();
+      out << "\n";
+    }
+    line_start = newline != nullptr;
+    ptr = stop;
+  }
+  position += size;
+}
+
+void TranslationWriter::FinishLine() {
+  if (pending.empty() == false) {
+    WriteLine(pending);
+    pending.clear();
+  }
+}
+
+// Each piece of the line is found with one pass over at most line_max characters,
+// so even a multi-megabyte initializer is split in time linear in its length. A
+// break goes after a comma or a space outside of a character literal, or anywhere
+// inside one. The piece ends with "&" and the next begins with "&", which is how
+// Fortran continues a literal (or any token) split across lines. Whether the next
+// piece begins inside a literal is carried over in quote. Without a stream, the
+// line is only measured, and that stops as soon as it is known not to fit.
+bool TranslationWriter::ContinueLine(StringRef line, raw_ostream *out) {
+  static const StringRef continuation = "    &";
+  StringRef prefix = "";
+  char quote = 0;  // The quote which opened the literal we are inside, if any.
+  size_t line_max = CToFTypeFormatter::line_max;
+  bool fits = true;
+  int continuations = 0;
+  while (prefix.size() + line.size() > line_max) {
+    if (continuations == CToFTypeFormatter::continuation_max) {
+      fits = false;  // The rest still goes out in pieces, though Fortran won't take them.
+      if (out == nullptr) {
+        break;
+      }
+    }
+    // Leave room for the "&" which ends the piece.
+    size_t limit = std::min(line.size(), line_max - prefix.size() - 1);
+    size_t split = 0;
+    char split_quote = 0;
+    bool comment = false;
+    for (size_t i = 0; i < limit; i++) {
+      char c = line[i];
+      if (quote != 0) {
+        if (c == quote) {  // A doubled quote simply closes and reopens the literal.
+          quote = 0;
+        } else {
+          split = i + 1;
+          split_quote = quote;
+        }
+      } else if (c == '\'' || c == '"') {
+        quote = c;
+      } else if (c == '!') {  // The rest is a comment, which may be as long as it likes.
+        comment = true;
+        break;
+      } else if (c == ',' || c == ' ') {
+        split = i + 1;
+        split_quote = 0;
+      }
+    }
+    if (comment == true) {
+      break;
+    } else if (split == 0) {  // Nowhere to split. The line goes out as it is.
+      fits = false;
+      break;
+    }
+    if (out != nullptr) {
+      *out << prefix << line.substr(0, split) << "&\n";
+    }
+    line = line.drop_front(split);
+    prefix = continuation;
+    quote = split_quote;
+    continuations++;
+  }
+  if (out != nullptr) {
+    *out << prefix << line;
+  }
+  return fits;
+}
+
+void TranslationWriter::WriteLine(StringRef line) {
+  ContinueLine(line, &out);
+}
+
+StringRef TranslationWriter::FindUnsplitLine(StringRef text) {
+  while (text.empty() == false) {
+    std::pair<StringRef, StringRef> lines = text.split('\n');
+    if (lines.first.size() > CToFTypeFormatter::line_max &&
+        ContinueLine(lines.first, nullptr) == false) {
+      return lines.first;
+    }
+    text = lines.second;
+  }
+  return StringRef();
+}
 
 // This complicated function determines from status and arguments what errors
 // should be emitted and whether a buffer should be commented out after a 
-// translation. The error string and a call to LineError will be emitted if
+// translation. The error string and its location will be reported if
 // the argument's value of quite and silent requires it. The error string should
 // be the text of the problem. A description will be added in.
 // The current_status is the status associated with the object that produced the error
 // and translation string. sloc is the location in the source files where
 // the translation began. args is the Arguments object associated with the 
-// current tool run.
-string CToFTypeFormatter::EmitTranslationAndErrors(status current_status, string
-    error_string, string translation_string, PresumedLoc sloc, Arguments &args) {
+// current tool run. The translation, commented out if need be and preceded by
+// a commented explanation of the problem, is written to out as it goes.
+void CToFTypeFormatter::EmitTranslationAndErrors(status current_status, string
+    error_string, StringRef translation_string, PresumedLoc sloc, Arguments &args,
+    raw_ostream &out) {
   bool silent = args.getSilent();  // This is for ease of access.
   bool emit_errors = false;  // Boolean to decide whether to print errors.
   bool comment_out = false;  // Boolean to decide whether to comment out text.
+  // The line explaining the problem, which goes (commented out) before the text.
+  const char *explanation = "";
+  bool emit_explanation = true;  // Text with no problem needs no explanation.
+  // A line too long for Fortran, which could not be continued anywhere (or not in
+  // few enough continuation lines), is the problem with a translation which has
+  // no other. It is commented out unless
+  // -ignore-line-length was given.
+  if (current_status == OKAY || (current_status == FUNC_MACRO &&
+      args.getHideMacros() == false)) {
+    StringRef long_line = TranslationWriter::FindUnsplitLine(translation_string);
+    if (long_line.empty() == false) {
+      current_status = BAD_LINE_LENGTH;
+      error_string = long_line.substr(0, line_max).str() + "...";
+    }
+  }
+  // Statistics (-stats-json) count every known status seen. Unknown ones have no
+  // place in the counts, so they are left out.
+  TranslationStats *stats = args.getStats();
+  bool known_status = current_status >= OKAY && current_status <= BAD_ARRAY;
+  if (stats != nullptr && known_status == true) {
+    stats->statuses[current_status]++;
+  }
 
   // From the status code, determine what kind of warnings to give
   // and whether to comment out the text.
-  if (current_status == OKAY) {  // No problem. Send the string right back.
-    return translation_string; 
+  if (current_status == OKAY) {  // No problem. Send the string right out.
+    emit_explanation = false;
   // Under certain options, we comment out function like macros.
+  } else if (current_status == FUNC_MACRO && args.getHideMacros() == false) {
+    emit_explanation = false;  // No problem. Send the string right out.
   } else if (current_status == FUNC_MACRO) {
-    if (args.getHideMacros() == false) {
-      return translation_string;  // No problem. Send the string right back.
-    }
-    translation_string = "Found function like macro.\n" + translation_string;
+    explanation = "Found function like macro.";
     error_string = "Warning: function like macro commented out: " + error_string;
     emit_errors = !silent;  // If not silent, emit errors.
     comment_out = true; 
@@ -60,12 +245,12 @@ string CToFTypeFormatter::EmitTranslationAndErrors(status current_status, string
     // There is an option to disable commenting out of this type
     // of problem. We check to see if that option has been invoked.
     comment_out = args.ShouldCommentOut(BAD_TYPE);
-    translation_string = "Found illegal type.\n" + translation_string;
+    explanation = "Found illegal type.";
     error_string = "Warning: Unrecognized or illegal type found: " + error_string;
   // An anonymous type has been discovered.
   } else if (current_status == BAD_ANON) {
     error_string = "Warning: anonymous type found:" + error_string;
-    translation_string = "Found anonymous type.\n" + translation_string;
+    explanation = "Found anonymous type.";
     comment_out = args.ShouldCommentOut(BAD_ANON);
     emit_errors = !silent;
   // Deal with illegally long names and lines.
@@ -73,45 +258,43 @@ string CToFTypeFormatter::EmitTranslationAndErrors(status current_status, string
     comment_out = args.ShouldCommentOut(BAD_LINE_LENGTH);
     emit_errors = !silent;
     error_string = "Warning: line exceeding length maximum found: " + error_string;
-    translation_string = "Found excessively long line.\n" + translation_string;
+    explanation = "Found excessively long line.";
   } else if (current_status == BAD_NAME_LENGTH) {
     comment_out = args.ShouldCommentOut(BAD_NAME_LENGTH);
     emit_errors = !silent;
     error_string = "Warning: name exceeding length maximum found: " + error_string;
-    translation_string = "Found excessively long name.\n" + translation_string;
+    explanation = "Found excessively long name.";
   // Something went wrong translating a structure initialization.
   } else if (current_status == BAD_STRUCT_TRANS) {
     comment_out = true;
     emit_errors = !silent;  
     error_string = "Warning: stucture translation failure: " + error_string;
-    translation_string = "Found structure translation failure.\n" +
-        translation_string;
+    explanation = "Found structure translation failure.";
   // This is an assumed size array in an illegal location.
   } else if (current_status == BAD_STAR_ARRAY) {
     comment_out = true;
     emit_errors = !silent;
     error_string = "Warning: bad use of variable size array: " + error_string;
-    translation_string = "Found bad use of variable size array\n" +
-        translation_string; 
+    explanation = "Found bad use of variable size array";
   // An attempt to translate a variable has gone awry.
   } else if (current_status == UNKNOWN_VAR) {
     comment_out = true;
     emit_errors = !silent;
     error_string = "Warning: failed variable translation: " + error_string;
-    translation_string = "Found bad variable translation.\n" + translation_string;
+    explanation = "Found bad variable translation.";
   // This is an internal error ie a nullpointer where one should not be.
   } else if (current_status == CRIT_ERROR) {
     comment_out = true;
     emit_errors = true;
     error_string = "Error during translation: " + error_string;
-    translation_string = "Error during translation.\n" + translation_string;
+    explanation = "Error during translation.";
   // This is a holdover from when h2m could not translate long or
   // unsigned macros. 
   } else if (current_status == U_OR_L_MACRO) {
     comment_out = true;
     emit_errors = !silent;
     error_string = "Warning: unsupported type in macro: " + error_string;
-    translation_string = "Found unsupported macro type\n" + translation_string;
+    explanation = "Found unsupported macro type";
   // A duplicate identifier was discovered.
   } else if (current_status == DUPLICATE) {
     // There is an option to not comment out this problem. 
@@ -119,46 +302,62 @@ string CToFTypeFormatter::EmitTranslationAndErrors(status current_status, string
     comment_out = args.ShouldCommentOut(DUPLICATE);
     emit_errors = !silent;
     error_string = "Warning: duplicate identifier detected: " + error_string;
-    translation_string = "Found duplicate identifier.\n" + translation_string;
+    explanation = "Found duplicate identifier.";
   } else if (current_status == BAD_ARRAY) {
     comment_out = true;
     emit_errors = !silent;
     error_string = "Warning: failed translation of array: " + error_string;
-    translation_string = "Found failed array translation.\n" + translation_string;
+    explanation = "Found failed array translation.";
   // An unrecognized macro type could not be translated.
   } else if (current_status == BAD_MACRO) {
     comment_out = true;
     emit_errors = !silent;
     error_string = "Warning: unrecognized macro type not translated: " + error_string;
-    translation_string = "Found unrecognized macro.\n" + translation_string;
+    explanation = "Found unrecognized macro.";
   } else {  // What sort of error is this?
     comment_out = true;
     emit_errors = !silent;
     error_string = "ERROR: unrecognized error code: " + error_string;
-    translation_string = "Unknown error\n" + translation_string;
+    explanation = "Unknown error";
   } 
 
   // Emit the errors if requested. Add in a newline for readabiilty.
   if (emit_errors == true) {
-    errs() << error_string << "\n";
-    CToFTypeFormatter::LineError(sloc);
+    Report(current_status, error_string, sloc, args);
   }
-
-  // Use a string stream to iterature through the lines of the declaration
-  // and comment it all out if necessary.
-  if (comment_out == true) {  // Comment out the declaration
-    std::istringstream in(translation_string);
-    translation_string = "";  // Zero out the string and put in commented text.
-    for (std::string line; std::getline(in, line);) {
-      translation_string += "! " + line + "\n";
+  // Some other problem (ie under -ignore-type) may let text with a line which is
+  // too long go out. That line still needs its warning, but the translation has
+  // already been counted under its own status.
+  if (comment_out == false && current_status != BAD_LINE_LENGTH) {
+    StringRef long_line = TranslationWriter::FindUnsplitLine(translation_string);
+    if (long_line.empty() == false) {
+      comment_out = args.ShouldCommentOut(BAD_LINE_LENGTH);
+      if (silent == false) {
+        Report(BAD_LINE_LENGTH, "Warning: line exceeding length maximum found: " +
+            long_line.substr(0, line_max).str() + "...", sloc, args);
+      }
     }
-  // If we are not commenting out the whole buffer, we need to comment out
-  // the first line in order to hide the error-explanation string which
-  // was added above.
-  } else {
-    translation_string = "! " + translation_string;
   }
-  return translation_string;
+
+  // The explanation is always commented out. The rest of the text is commented
+  // out line by line as it is written if necessary.
+  if (comment_out == true && stats != nullptr && known_status == true) {
+    stats->commented_out[current_status]++;
+  }
+  // Long lines are continued by the writer.
+  TranslationWriter writer(out);
+  if (emit_explanation == true) {
+    writer.setCommentOut(true);
+    writer << explanation << "\n";
+    writer.setCommentOut(comment_out);
+  }
+  writer << translation_string;
+  // A commented out last line still needs its end.
+  if (comment_out == true && translation_string.empty() == false &&
+      translation_string.back() != '\n') {
+    writer << "\n";
+  }
+  writer.FinishLine();
 }
 
 // -----------initializer RecordDeclFormatter--------------------
@@ -272,8 +471,8 @@ string  CToFTypeFormatter::getFortranArrayDimsASString() {
         // This is likely a serious issue. It may prevent compilation. There is
         // no guarantee that this expression is evaluatable in Fortran.
         if (args.getSilent() == false) { 
-          errs() << "Warning: unevaluatable array dimensions: " << expr_text << "\n";
-          CToFTypeFormatter::LineError(sloc);
+          Warn(ARRAY_DIMENSIONS, "Warning: unevaluatable array dimensions: " + expr_text,
+              sloc, args);
         }
       }
     
@@ -324,126 +523,143 @@ bool CToFTypeFormatter::isArrayType() {
 // or just of the form C_QUALIFIER. True means it needs the FORTRANTYPE(C_QUALIFIER)
 // format. In the case of a problem (anonymous or unrecognized type), the bool
 // problem is set to true. It also catches any type mentioning "va_list".
+// The answer is looked up in the type cache first, if there is one.
 string CToFTypeFormatter::getFortranTypeASString(bool typeWrapper, bool &problem) {
+  TypeCache *cache = args.getTypeCache();
+  TypeCache::Entry *entry = cache != nullptr ? cache->getEntry(c_qualType, ac) : nullptr;
+  if (entry == nullptr) {
+    return TranslateType(typeWrapper, problem);
+  }
+  if (entry->known[typeWrapper] == false) {
+    bool type_problem = false;
+    string f_type = TranslateType(typeWrapper, type_problem);
+    // Translating an array type adds its element type, which may move this entry.
+    entry = cache->getEntry(c_qualType, ac);
+    entry->forms[typeWrapper] = f_type;
+    entry->known[typeWrapper] = true;
+    entry->problem[typeWrapper] = type_problem;
+  }
+  problem = entry->problem[typeWrapper];
+  return entry->forms[typeWrapper];
+}
+
+// The Fortran type and iso_c_binding kind of each C builtin arithmetic type.
+// Kinds not listed are integers assumed to be C_INT.
+struct FortranKind {
+  const char *type;  // ie INTEGER, used when the type is wrapped
+  const char *kind;  // ie C_INT
+};
+
+static FortranKind BuiltinFortranKind(BuiltinType::Kind kind) {
+  switch (kind) {
+    case BuiltinType::Bool: return {"LOGICAL", "C_BOOL"};
+    case BuiltinType::Char_S: case BuiltinType::Char_U: return {"CHARACTER", "C_CHAR"};
+    case BuiltinType::SChar: case BuiltinType::UChar: return {"INTEGER", "C_SIGNED_CHAR"};
+    case BuiltinType::Short: case BuiltinType::UShort: return {"INTEGER", "C_SHORT"};
+    case BuiltinType::Long: case BuiltinType::ULong: return {"INTEGER", "C_LONG"};
+    case BuiltinType::LongLong: case BuiltinType::ULongLong: return {"INTEGER", "C_LONG_LONG"};
+    case BuiltinType::Float: return {"REAL", "C_FLOAT"};
+    case BuiltinType::LongDouble: return {"REAL", "C_LONG_DOUBLE"};
+    case BuiltinType::Float128: return {"REAL", "C_FLOAT128"};
+    // Other reals (double and half) are assumed to be doubles.
+    case BuiltinType::Double: case BuiltinType::Half: return {"REAL", "C_DOUBLE"};
+    default: return {"INTEGER", "C_INT"};
+  }
+}
+
+// Some integer typedefs from <stddef.h> and <stdint.h> have kinds of their own.
+// bits is the width an exact-width type must have, or 0 if the width needn't be
+// checked. The unsigned types share the kinds of the signed ones, since Fortran has
+// no unsigned integers.
+struct TypedefKind {
+  const char *kind;
+  unsigned bits;
+};
+
+static TypedefKind LookupTypedefKind(StringRef name) {
+  // The C library's own spellings (ie __int64_t) are the same types.
+  if (name.startswith("__") == true) {
+    name = name.drop_front(2);
+  }
+  return llvm::StringSwitch<TypedefKind>(name)
+      .Case("size_t", {"C_SIZE_T", 0})
+      .Case("ptrdiff_t", {"C_PTRDIFF_T", 0})
+      .Cases("intptr_t", "uintptr_t", {"C_INTPTR_T", 0})
+      .Cases("intmax_t", "uintmax_t", {"C_INTMAX_T", 0})
+      .Cases("int8_t", "uint8_t", {"C_INT8_T", 8})
+      .Cases("int16_t", "uint16_t", {"C_INT16_T", 16})
+      .Cases("int32_t", "uint32_t", {"C_INT32_T", 32})
+      .Cases("int64_t", "uint64_t", {"C_INT64_T", 64})
+      .Cases("int_least8_t", "uint_least8_t", {"C_INT_LEAST8_T", 0})
+      .Cases("int_least16_t", "uint_least16_t", {"C_INT_LEAST16_T", 0})
+      .Cases("int_least32_t", "uint_least32_t", {"C_INT_LEAST32_T", 0})
+      .Cases("int_least64_t", "uint_least64_t", {"C_INT_LEAST64_T", 0})
+      .Cases("int_fast8_t", "uint_fast8_t", {"C_INT_FAST8_T", 0})
+      .Cases("int_fast16_t", "uint_fast16_t", {"C_INT_FAST16_T", 0})
+      .Cases("int_fast32_t", "uint_fast32_t", {"C_INT_FAST32_T", 0})
+      .Cases("int_fast64_t", "uint_fast64_t", {"C_INT_FAST64_T", 0})
+      .Default({nullptr, 0});
+}
+
+// The kind is found by name anywhere along the chain of typedefs, so a typedef of
+// int64_t is still a C_INT64_T whether int64_t is a long (LP64) or a long long
+// (LLP64) underneath. An exact-width name is only believed if the type really has
+// that width. An empty string means the chain holds none of these types.
+static StringRef TypedefFortranKind(QualType qt, ASTContext &ac) {
+  while (const TypedefType *typedef_type = qt->getAs<TypedefType>()) {
+    const TypedefNameDecl *decl = typedef_type->getDecl();
+    TypedefKind kind = LookupTypedefKind(decl->getName());
+    if (kind.kind != nullptr && (kind.bits == 0 || ac.getTypeSize(qt) == kind.bits)) {
+      return kind.kind;
+    }
+    qt = decl->getUnderlyingType();
+  }
+  return "";
+}
+
+// This is where the translation is actually done. Arithmetic types are classified by
+// their builtin kind (after the sugar is stripped off) and a few typedefs instead of
+// by matching their printed names.
+string CToFTypeFormatter::TranslateType(bool typeWrapper, bool &problem) {
   string f_type = "";
   problem = false;  // Set this for safety. The caller should also set it to false.
 
-  // Handle character types
-  if (c_qualType.getTypePtr()->isCharType()) {
+  // Handle the integer typedefs with kinds of their own
+  StringRef typedef_kind;
+  if (c_qualType.getTypePtr()->isIntegerType()) {
+    typedef_kind = TypedefFortranKind(c_qualType, ac);
+  }
+  if (typedef_kind.empty() == false) {
     if (typeWrapper) {
-      f_type = "CHARACTER(C_CHAR)";
+      f_type = "INTEGER(" + typedef_kind.str() + ")";
     } else {
-      f_type = "C_CHAR";
+      f_type = typedef_kind;
     }
-  // Handle boolean types
-  } else if (c_qualType.getTypePtr()->isBooleanType()) {
-    if (typeWrapper) {
-      f_type = "LOGICAL(C_BOOL)";
-    } else {
-      f_type = "C_BOOL";
-    }
-  // Handle integer types
-  } else if (c_qualType.getTypePtr()->isIntegerType()) {
-     // Match the necessary integer type with string matching because
-     // different types may have the same size in bytes.
-     // Handle a size_t
-     if (c_qualType.getAsString()== "size_t") {
-      if (typeWrapper) {
-        f_type = "INTEGER(C_SIZE_T)";
-      } else {
-        f_type = "C_SIZE_T";
-      }
-    // Handle integers which are 'chars'
-    } else if (c_qualType.getAsString()== "unsigned char" || c_qualType.getAsString()== "signed char") {
-      if (typeWrapper) {
-        f_type = "INTEGER(C_SIGNED_CHAR)";
-      } else {
-        f_type = "C_SIGNED_CHAR";
-      }        
-    // Handle a short type
-    } else if (c_qualType.getAsString().find("short") != std::string::npos) {
-      if (typeWrapper) {
-        f_type = "INTEGER(C_SHORT)";
-      } else {
-        f_type = "C_SHORT";
-      }  
-    // Handle a long long
-    } else if (c_qualType.getAsString().find("long long") != std::string::npos) {
-      if (typeWrapper) {
-        f_type = "INTEGER(C_LONG_LONG)";
-      } else {
-        f_type = "C_LONG_LONG";
-      }
-    // Handle a regular long
-    } else if (c_qualType.getAsString().find("long") != std::string::npos) {
-      if (typeWrapper) {
-        f_type = "INTEGER(C_LONG)";
-      } else {
-        f_type = "C_LONG";
-      }      
-    // There are other types of ints, but a type of INT is assumed.
-    } else {
-      if (typeWrapper) {
-        f_type = "INTEGER(C_INT)";
-      } else {
-        f_type = "C_INT";
-      }      
+  // Handle character, boolean, integer and real types. Integer types which are not
+  // builtins (enums) are C_INT.
+  } else if (c_qualType.getTypePtr()->isIntegerType() ||
+      c_qualType.getTypePtr()->isRealType()) {
+    FortranKind kind = {"INTEGER", "C_INT"};
+    if (const BuiltinType *builtin = c_qualType->getAs<BuiltinType>()) {
+      kind = BuiltinFortranKind(builtin->getKind());
     }
-
-  // Handle the translation of all REAL types.
-  } else if (c_qualType.getTypePtr()->isRealType()) {
-    // Handle translation of a long double
-    if (c_qualType.getAsString().find("long") != std::string::npos) {
-      if (typeWrapper) {
-        f_type = "REAL(C_LONG_DOUBLE)";
-      } else {
-        f_type = "C_LONG_DOUBLE";
-      } 
-    // Handle translation of a float
-    } else if (c_qualType.getAsString()== "float") {
-      if (typeWrapper) {
-        f_type = "REAL(C_FLOAT)";
-      } else {
-        f_type = "C_FLOAT";
-      }
-    // Handle translation of a float_128
-    } else if (c_qualType.getAsString()== "__float128") {
-      if (typeWrapper) {
-        f_type = "REAL(C_FLOAT128)";
-      } else {
-        f_type = "C_FLOAT128";
-      }
-    // Assume that this "other" kind of real is a double
+    if (typeWrapper) {
+      f_type = string(kind.type) + "(" + kind.kind + ")";
     } else {
-      if (typeWrapper) {
-        f_type = "REAL(C_DOUBLE)";
-      } else {
-        f_type = "C_DOUBLE";
-      }      
+      f_type = kind.kind;
     }
-  // Handle translation of a C derived complex type
+  // Handle translation of a C derived complex type by its element type
   } else if (c_qualType.getTypePtr()->isComplexType ()) {
-    // Handle translation of a complex float
-    if (c_qualType.getAsString().find("float") != std::string::npos) {
-      if (typeWrapper) {
-        f_type = "COMPLEX(C_FLOAT_COMPLEX)";
-      } else {
-        f_type = "C_FLOAT_COMPLEX";
-      }        
-    // Handle translation of a complex long double
-    } else if (c_qualType.getAsString().find("long") != std::string::npos) {
-      if (typeWrapper) {
-        f_type = "COMPLEX(C_LONG_DOUBLE_COMPLEX)";
-      } else {
-        f_type = "C_LONG_DOUBLE_COMPLEX";
-      }
-    // Assume that this is a complex double type and handle it as such
-    } else {
-      if (typeWrapper) {
-        f_type = "COMPLEX(C_DOUBLE_COMPLEX)";
-      } else {
-        f_type = "C_DOUBLE_COMPLEX";
-      }
+    const ComplexType *complex = c_qualType->getAs<ComplexType>();
+    const BuiltinType *element = complex->getElementType()->getAs<BuiltinType>();
+    f_type = "C_DOUBLE_COMPLEX";  // Assume that this is a complex double
+    if (element != nullptr && element->getKind() == BuiltinType::Float) {
+      f_type = "C_FLOAT_COMPLEX";
+    } else if (element != nullptr && element->getKind() == BuiltinType::LongDouble) {
+      f_type = "C_LONG_DOUBLE_COMPLEX";
+    }
+    if (typeWrapper) {
+      f_type = "COMPLEX(" + f_type + ")";
     }
   // Translate a C pointer
   } else if (c_qualType.getTypePtr()->isPointerType ()) {
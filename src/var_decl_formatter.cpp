@@ -14,8 +14,9 @@ VarDeclFormatter::VarDeclFormatter(VarDecl *v, Rewriter &r, Arguments &arg) :
   // locations. If it isn't initialized, it isn't valid according to the Clang
   //  check made in the helper.
   if (varDecl->getSourceRange().getBegin().isValid()) {
-    isInSystemHeader = rewriter.getSourceMgr().isInSystemHeader(
-        varDecl->getSourceRange().getBegin());
+    isInSystemHeader = CToFTypeFormatter::isExcludedSystemHeader(
+        varDecl->getSourceRange().getBegin(),
+        rewriter.getSourceMgr(), args);
     sloc = rewriter.getSourceMgr().getPresumedLoc(
         varDecl->getSourceRange().getBegin());
   } else {
@@ -23,6 +24,25 @@ VarDeclFormatter::VarDeclFormatter(VarDecl *v, Rewriter &r, Arguments &arg) :
   }
 };
 
+bool VarDeclFormatter::isCharacter(QualType qt) {
+  if (qt.getTypePtr()->isCharType() == false) {
+    return false;
+  }
+  CToFTypeFormatter tf(qt, varDecl->getASTContext(), sloc, args);
+  bool problem = false;
+  return tf.getFortranTypeASString(false, problem) == "C_CHAR";
+}
+
+string VarDeclFormatter::getCharValueASString(const APSInt &value, bool is_character) {
+  if (is_character == true) {
+    string literal = "'";
+    literal += static_cast<char>(value.getExtValue());
+    literal += "'";
+    return literal;
+  }
+  return to_string(APSInt(value, false).getExtValue());
+}
+
 // In the event that a variable declaration has an initial value, this function
 // attempts to find that initialization value and return it as a string. It handles
 // pointers, reals, complexes, characters, ints. Arrays are defined here but actually
@@ -38,11 +58,9 @@ string VarDeclFormatter::getInitValueASString() {
         // Which occurs elsewhere (special call from getVarDeclAsString).
         // This should never be called but is here for safety.
     } else if (varDecl->getType().getTypePtr()->isCharType()) {
-        // single CHAR
-      char character = varDecl->evaluateValue()->getInt().getExtValue();
-      string cString;
-      cString += character;
-      valString = "\'" + cString + "\'";
+        // single CHAR, or a signed or unsigned char which is an INTEGER
+      valString = getCharValueASString(varDecl->evaluateValue()->getInt(),
+          isCharacter(varDecl->getType()));
     } else if (varDecl->getType().getTypePtr()->isIntegerType()) {
         // INT
       int intValue = varDecl->evaluateValue ()->getInt().getExtValue();
@@ -66,7 +84,7 @@ string VarDeclFormatter::getInitValueASString() {
       // POINTER 
       QualType pointerType = varDecl->getType();
       QualType pointeeType = pointerType.getTypePtr()->getPointeeType();
-      if (pointeeType.getTypePtr()->isCharType()) {
+      if (isCharacter(pointeeType)) {
         // string literal
         // This parses out the string from a string literal
         // and then wraps it in Fortran syntax.
@@ -85,9 +103,8 @@ string VarDeclFormatter::getInitValueASString() {
         valString = "!" + varDecl->evaluateValue()->getAsString(
             varDecl->getASTContext(), varDecl->getType());
         if (args.getSilent() == false && args.getQuiet() == false) {
-          errs() << "Variable declaration initialization commented out:\n";
-          errs() << valString << "\n";
-          CToFTypeFormatter::LineError(sloc); 
+          CToFTypeFormatter::Warn(CToFTypeFormatter::COMMENTED_OUT,
+              "Variable declaration initialization commented out:\n" + valString, sloc, args);
         }
       }
     } else if (varDecl->getType().getTypePtr()->isArrayType()) {
@@ -97,14 +114,16 @@ string VarDeclFormatter::getInitValueASString() {
       string arrayText = Lexer::getSourceText(CharSourceRange::getTokenRange(exp->getExprLoc(),
           varDecl->getSourceRange().getEnd()), rewriter.getSourceMgr(), LangOptions(), 0);
       // comment out arrayText
-      std::istringstream in(arrayText);
-      for (std::string line; std::getline(in, line);) {
-        if (args.getQuiet() == false && args.getSilent() == false) {
-          errs() << "Warning: array contents " << line << " commented out \n";
-          CToFTypeFormatter::LineError(sloc);
+      LineBuffer commented;
+      commented.appendCommentedOut(arrayText);
+      if (args.getQuiet() == false && args.getSilent() == false) {
+        for (size_t i = 0; i < commented.getLineCount(); i++) {
+          CToFTypeFormatter::Warn(CToFTypeFormatter::COMMENTED_OUT,
+              "Warning: array contents " + commented.getLine(i).drop_front(2).str() +
+              " commented out ", sloc, args);
         }
-        valString += "! " + line + "\n";
       }
+      valString += commented.str();
     } else {  // Unknown variable declaration.
       current_status = CToFTypeFormatter::UNKNOWN_VAR;
       error_string = "Unknown variable declaration: " + valString;
@@ -150,15 +169,10 @@ void VarDeclFormatter::getFortranArrayEleASString(InitListExpr *ile, string &arr
       // want to use. This doesn't necessarilly follow the language standard.
       innerelement->EvaluateAsRValue(r, varDecl->getASTContext());
       string eleVal = r.Val.getAsString(varDecl->getASTContext(), innerelement->getType());
-      // We must convert this integer string into a char. This is annoying.
-      if (is_char == true) {
-        // This will throw an exception if it fails but it should succeed.
-        int temp_val = std::stoi(eleVal);
-        char temp_char = static_cast<char>(temp_val);
-        // Put the character into place and surround it by quotes
-        eleVal = "'";
-        eleVal += temp_char;
-        eleVal += "'";
+      // We must convert this integer into a char, unless it is an INTEGER char.
+      if (innerelement->getType().getTypePtr()->isCharType() == true &&
+          r.Val.isInt() == true) {
+        eleVal = getCharValueASString(r.Val.getInt(), is_char);
       }
 
       if (arrayValues.empty()) {  // Handle putting in the first element.
@@ -218,15 +232,10 @@ string VarDeclFormatter::getFortranStructFieldsASString(Expr *exp) {
         eleVal = r.Val.getAsString(varDecl->getASTContext(), e_qualType); 
           
         // Char types need to be handled specially so as not to be translated
-        // into integers. Fortran does not like CHARACTER a = 97.
-        if (e_qualType.getTypePtr()->isCharType() == true) {
-            // Transfer the evaluated string to integer
-            int temp_val = std::stoi(eleVal);
-            char temp_char = static_cast<char>(temp_val);
-            // Turn the integer back into a character
-            eleVal = "'";
-            eleVal += temp_char;
-            eleVal += "'";
+        // into integers. Fortran does not like CHARACTER a = 97. Signed and
+        // unsigned chars are INTEGERs, which do want integers.
+        if (e_qualType.getTypePtr()->isCharType() == true && r.Val.isInt() == true) {
+          eleVal = getCharValueASString(r.Val.getInt(), isCharacter(e_qualType));
                       
         // If the field is a pointer, determine if it is a string literal and
         // handle that, otherwise set it to a void pointer because what else
@@ -235,7 +244,7 @@ string VarDeclFormatter::getFortranStructFieldsASString(Expr *exp) {
           QualType pointeeType = e_qualType.getTypePtr()->getPointeeType();
 
           // We've found a string literal.
-          if (pointeeType.getTypePtr()->isCharType()) {
+          if (isCharacter(pointeeType)) {
             if (isa<ImplicitCastExpr>(exp)) {
               ImplicitCastExpr *ice = cast<ImplicitCastExpr> (exp);
               Expr *subExpr = ice->getSubExpr();
@@ -256,18 +265,16 @@ string VarDeclFormatter::getFortranStructFieldsASString(Expr *exp) {
             structDecl += "& ! Initial pointer value: " + eleVal +
                 " set to C_NULL_FUNPTR\n";
             if (args.getSilent() == false) {
-              errs() << "Warning: pointer value " << eleVal << 
-                  " set to C_NULL_FUNPTR\n";
-              CToFTypeFormatter::LineError(sloc);
+              CToFTypeFormatter::Warn(CToFTypeFormatter::NULL_POINTER,
+                  "Warning: pointer value " + eleVal + " set to C_NULL_FUNPTR", sloc, args);
             }
             eleVal = "C_NULL_FUNPTR";
           } else {
             structDecl += "& ! Initial pointer value: " + eleVal + 
                 " set to C_NULL_PTR\n";
             if (args.getSilent() == false) {
-              errs() << "Warning: pointer value " << eleVal << 
-                  " set to C_NULL_PTR\n";
-              CToFTypeFormatter::LineError(sloc);
+              CToFTypeFormatter::Warn(CToFTypeFormatter::NULL_POINTER,
+                  "Warning: pointer value " + eleVal + " set to C_NULL_PTR", sloc, args);
             }
             eleVal = "C_NULL_PTR";
           }
@@ -275,8 +282,8 @@ string VarDeclFormatter::getFortranStructFieldsASString(Expr *exp) {
         // how to handle string literals, but only string literals should
         // actually be evaluatable. All others will lead to recursive calls.
         } else if (e_qualType.getTypePtr()->isArrayType() == true) {
-          bool isChar = varDecl->getASTContext().getBaseElementType(
-              e_qualType).getTypePtr()->isCharType();
+          bool isChar = isCharacter(varDecl->getASTContext().getBaseElementType(
+              e_qualType));
           // This implies a string literal has been found.
           if (eleVal.front() == '&' && isChar == true) {
             // Erase up to the beginning of the & symbol which may be present because 
@@ -305,8 +312,8 @@ string VarDeclFormatter::getFortranStructFieldsASString(Expr *exp) {
             // Determine whether this is a char array, needing special
             // evaluation, or not (do we need to cast an int to char to
             // avoid saying "CHARACTER(C_CHAR) = RESHAPE((/97...")))?
-            bool isChar = varDecl->getASTContext().getBaseElementType(
-                e_qualType).getTypePtr()->isCharType();
+            bool isChar = isCharacter(varDecl->getASTContext().getBaseElementType(
+                e_qualType));
             // Call a helper to get the array in string form. This function deals with all possible 
             // array nesting. The array_success flag will reflect the helper's status.
             getFortranArrayEleASString(in_list_exp, values, shapes, array_success,
@@ -348,8 +355,8 @@ string VarDeclFormatter::getFortranStructFieldsASString(Expr *exp) {
               element->getLocEnd()), rewriter.getSourceMgr(), LangOptions(), 0);
           eleVal = "& ! Function pointer " + value + " set to C_NULL_FUNPTR\n" + eleVal;
           if (args.getSilent() == false) {
-            errs() << "Warning: pointer value " << value << " set to C_NULL_FUNPTR\n";
-            CToFTypeFormatter::LineError(sloc);
+            CToFTypeFormatter::Warn(CToFTypeFormatter::NULL_POINTER,
+                "Warning: pointer value " + value + " set to C_NULL_FUNPTR", sloc, args);
           }
         } else if (e_qualType.getTypePtr()->getUnqualifiedDesugaredType()->isPointerType() == true) {
           eleVal = "C_NULL_PTR";      
@@ -358,8 +365,8 @@ string VarDeclFormatter::getFortranStructFieldsASString(Expr *exp) {
               element->getLocEnd()), rewriter.getSourceMgr(), LangOptions(), 0);
           eleVal = "& ! Pointer " + value + " set to C_NULL_PTR\n" + eleVal;
           if (args.getSilent() == false) {
-            errs() << "Warning: pointer value " << value << " set to C_NULL_PTR\n";
-            CToFTypeFormatter::LineError(sloc);
+            CToFTypeFormatter::Warn(CToFTypeFormatter::NULL_POINTER,
+                "Warning: pointer value " + value + " set to C_NULL_PTR", sloc, args);
           }
         } else {  // We have no idea what this is or how to translate it. Warn and comment out.
           string value = Lexer::getSourceText(CharSourceRange::getTokenRange(element->getLocStart(),
@@ -457,9 +464,9 @@ string VarDeclFormatter::getFortranArrayDeclASString() {
       QualType e_qualType = at->getElementType();
       Expr *exp = varDecl->getInit();
       // Whether this is a char array or not will have to be checked several times.
-      // This checks whether or not the "innermost" type is a char type.
-      bool isChar = varDecl->getASTContext().getBaseElementType(
-          e_qualType).getTypePtr()->isCharType();
+      // This checks whether or not the "innermost" type is a CHARACTER.
+      bool isChar = isCharacter(varDecl->getASTContext().getBaseElementType(
+          e_qualType));
       // This fetches the actual text initialization, which may be 
       // a string literal or {'a', 'b'...}.
       string arrayText = Lexer::getSourceText(CharSourceRange::getTokenRange(exp->getExprLoc(),
@@ -475,6 +482,28 @@ string VarDeclFormatter::getFortranArrayDeclASString() {
           current_status = CToFTypeFormatter::BAD_TYPE;
           error_string = tf.getFortranTypeASString(true, problem);
         }
+      } else if (isa<clang::StringLiteral>(exp->IgnoreImpCasts()) &&
+          isa<ConstantArrayType>(at) && e_qualType.getTypePtr()->isCharType()) {
+        // A string literal may also initialize an array of signed or unsigned chars,
+        // which are INTEGERs. Its bytes are written as integers, with the zeros which
+        // fill out the rest of the array.
+        StringRef bytes = cast<clang::StringLiteral>(exp->IgnoreImpCasts())->getBytes();
+        uint64_t size = cast<ConstantArrayType>(at)->getSize().getZExtValue();
+        string arrayValues;
+        for (uint64_t i = 0; i < size; i++) {
+          unsigned char byte = i < bytes.size() ? bytes[i] : 0;
+          arrayValues += (i == 0 ? "" : ", ") +
+              getCharValueASString(APSInt(APInt(8, byte), true), false);
+        }
+        string shape = to_string(size);
+        bool problem = false;  // The helper sends back this flag for an invalid type
+        arrayDecl += tf.getFortranTypeASString(true, problem) + ", BIND(C" + bindname +
+            ") :: " + identifier + "(" + shape + ")";
+        if (problem == true) {  // We have found a bad type.
+          current_status = CToFTypeFormatter::BAD_TYPE;
+          error_string = identifier + ", array definition.";
+        }
+        arrayDecl += " = RESHAPE((/" + arrayValues + "/), (/" + shape + "/))\n";
       } else {  // This is not a string literal but a standard C array.
         bool evaluatable = false;
         Expr *exp = varDecl->getInit();
@@ -512,18 +541,10 @@ string VarDeclFormatter::getFortranArrayDeclASString() {
 
                 // In the case of a char array initalized ie {'a', 'b',...} we require a 
                 // check and a conversion of the int value produced into a char value which
-                // is valid in a Fortran character array.
-                if (isChar == true) {
-                  // Transfering the arbitrary percision int to a string then back to an int is
-                  // easier than trying to get an integer from the arbitrary precision value.
-                  // On a failed conversion, this throws an exception. That shouldn't happen.
-                  int temp_val = std::stoi(eleVal);
-                  char temp_char = static_cast<char>(temp_val);
-                  // Assembles the necessary syntax for a Fortran char array, a component is: 'a'...
-                  // This is split into three lines to avoid some problems with overloaded string '+'.
-                  eleVal = "'";
-                  eleVal += temp_char;
-                  eleVal += "'";
+                // is valid in a Fortran character array. The elements of a signed or
+                // unsigned char array stay integers.
+                if (e_qualType.getTypePtr()->isCharType() == true && r.Val.isInt() == true) {
+                  eleVal = getCharValueASString(r.Val.getInt(), isChar);
                 }
 
                 if (it == elements.begin()) {
@@ -572,7 +593,8 @@ string VarDeclFormatter::getFortranArrayDeclASString() {
 // fetched with the helper function getFortranTypeASString. Any illegal identifiers
 // (ie _thing) are prepended with "h2m" to become legal fortran identifiers.
 string VarDeclFormatter::getFortranVarDeclASString() {
-  string vd_buffer = "";
+  // The buffer keeps track of its lines (and their lengths) as it is built.
+  LineBuffer vd_buffer;
   string identifier = "";   // Will eventually hold the variable's name
   string bindname = "";  // May eventually hold a value to bind to (BIND (C, name ="...")
   bool struct_error = false;  // Flag for a special error during struct translation
@@ -632,7 +654,7 @@ string VarDeclFormatter::getFortranVarDeclASString() {
       identifier = identifier.substr(0, identifier.find_first_of("("));
       vd_buffer = getFortranArrayDeclASString();
     } else if (varDecl->getType().getTypePtr()->isPointerType() && 
-      varDecl->getType().getTypePtr()->getPointeeType()->isCharType()) {
+      isCharacter(varDecl->getType().getTypePtr()->getPointeeType())) {
       // This is a string declaration
       string value = getInitValueASString();
       CToFTypeFormatter tf(varDecl->getType().getTypePtr()->getPointeeType(),
@@ -719,29 +741,21 @@ string VarDeclFormatter::getFortranVarDeclASString() {
     }
 
     // Check for a repeated identifier.
-    bool not_duplicate = RecordDeclFormatter::StructAndTypedefGuard(identifier);
+    string original;
+    bool not_duplicate = RecordDeclFormatter::StructAndTypedefGuard(identifier, args,
+        "variable", sloc, original);
     if (not_duplicate == false) {  // This is a duplicate identifier
       current_status = CToFTypeFormatter::DUPLICATE;
-      error_string = identifier;
+      error_string = identifier + ", " + original + ".";
     }
     // Check for an overly long identifier.
     if (identifier.length() > CToFTypeFormatter::name_max) {
       current_status = CToFTypeFormatter::BAD_NAME_LENGTH;
       error_string = identifier;
     }
-    // Check for an excessively long line in the declaration by
-    // looping through all the lines in a string stream. An empty
-    // string will not be a problem.
-    std::istringstream in(vd_buffer);
-    for (std::string line; std::getline(in, line);) {
-      // Trim the line to the point where a comment begins if it does.
-      line = line.substr(0, line.find_first_of("!"));
-      if (line.length() > CToFTypeFormatter::line_max) {
-        current_status = CToFTypeFormatter::BAD_LINE_LENGTH;
-        error_string = line + ", in variable declaration.";
-      }
-    }
+    // Long initializers are not a problem here. The lines are continued as
+    // they are written out.
   }  // End processing of non-system headers
-  return vd_buffer;
+  return vd_buffer.str();
 };
 